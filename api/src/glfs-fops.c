@@ -16,7 +16,7 @@
 
 
 int
-glfs_loc_link (loc_t *loc, struct iatt *iatt)
+glfs_loc_link (struct glfs *fs, loc_t *loc, struct iatt *iatt)
 {
 	int ret = -1;
 	inode_t *linked_inode = NULL;
@@ -29,6 +29,7 @@ glfs_loc_link (loc_t *loc, struct iatt *iatt)
 	linked_inode = inode_link (loc->inode, loc->parent, loc->name, iatt);
 	if (linked_inode) {
 		inode_lookup (linked_inode);
+		glfs_inode_track (fs, linked_inode);
 		inode_unref (linked_inode);
 		ret = 0;
 	} else {
@@ -116,6 +117,8 @@ retry:
 	}
 
 	ret = syncop_open (subvol, &loc, flags, glfd->fd);
+	if (flags & O_TRUNC)
+		glfs_iatt_cache_invalidate (fs, loc.inode);
 
 	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 out:
@@ -141,6 +144,8 @@ glfs_close (struct glfs_fd *glfd)
 {
 	xlator_t  *subvol = NULL;
 	int        ret = -1;
+	int        wb_ret = 0;
+	int        wb_errno = 0;
 	fd_t      *fd = NULL;
 	struct glfs *fs = NULL;
 
@@ -160,7 +165,14 @@ glfs_close (struct glfs_fd *glfd)
 		goto out;
 	}
 
+	wb_ret = glfs_wb_sync (glfd, subvol, fd);
+	wb_errno = errno;
+
 	ret = syncop_flush (subvol, fd);
+	if (wb_ret) {
+		ret = -1;
+		errno = wb_errno;
+	}
 out:
 	fs = glfd->fs;
 	glfs_fd_destroy (glfd);
@@ -264,6 +276,10 @@ glfs_fstat (struct glfs_fd *glfd, struct stat *stat)
 		goto out;
 	}
 
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
 	ret = syncop_fstat (subvol, fd, &iatt);
 
 	if (ret == 0 && stat)
@@ -384,15 +400,17 @@ retry:
 
 	if (ret == 0) {
 		ret = syncop_open (subvol, &loc, flags, glfd->fd);
+		glfs_loc_invalidate (fs, &loc);
 	} else {
 		ret = syncop_create (subvol, &loc, flags, mode, glfd->fd,
 				     xattr_req, &iatt);
+		glfs_loc_invalidate (fs, &loc);
 	}
 
 	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 
 	if (ret == 0)
-		ret = glfs_loc_link (&loc, &iatt);
+		ret = glfs_loc_link (fs, &loc, &iatt);
 out:
 	loc_wipe (&loc);
 
@@ -443,581 +461,915 @@ glfs_lseek (struct glfs_fd *glfd, off_t offset, int whence)
 }
 
 
-//////////////
+///// read-ahead /////
 
-ssize_t
-glfs_preadv (struct glfs_fd *glfd, const struct iovec *iovec, int iovcnt,
-	     off_t offset, int flags)
-{
-	xlator_t       *subvol = NULL;
-	ssize_t         ret = -1;
-	ssize_t         size = -1;
-	struct iovec   *iov = NULL;
-	int             cnt = 0;
-	struct iobref  *iobref = NULL;
-	fd_t           *fd = NULL;
+struct glfs_ra_page {
+	struct list_head     list;
+	struct list_head     wind_list;
+	struct glfs_ra      *ra;
+	off_t                offset;
+	size_t               size;
+	int                  ready;
+	int                  stale; /* dropped while in flight */
+	ssize_t              ret;
+	struct iovec        *iov;
+	int                  count;
+	struct iobref       *iobref;
+	xlator_t            *subvol;
+	fd_t                *fd;
+};
 
-	__glfs_entry_fd (glfd);
+struct glfs_ra {
+	struct glfs         *fs;
+	pthread_mutex_t      mutex;
+	pthread_cond_t       cond;
+	struct list_head     pages; /* by offset, ready or in flight */
+	int                  npages;
+	int                  inflight;
+	off_t                expected; /* where a sequential read starts,
+					  -1 until a first read */
+	uint64_t             gen; /* glfs_inode_gen() the pages are from */
+	off_t                next; /* where the next page is read from */
+	off_t                eof; /* -1 until a short read is seen */
+};
 
-	subvol = glfs_active_subvol (glfd->fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
 
-	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
-	if (!fd) {
-		ret = -1;
-		errno = EBADFD;
-		goto out;
-	}
+static void
+glfs_ra_page_free (struct glfs_ra_page *page)
+{
+	GF_FREE (page->iov);
+	if (page->iobref)
+		iobref_unref (page->iobref);
+	GF_FREE (page);
+}
 
-	size = iov_length (iovec, iovcnt);
 
-	ret = syncop_readv (subvol, fd, size, offset, 0, &iov, &cnt, &iobref);
-	if (ret <= 0)
-		goto out;
+/* Drops all pages. Those still in flight are freed by their callback. */
+static void
+__glfs_ra_drop (struct glfs_ra *ra)
+{
+	struct glfs_ra_page *page = NULL;
+	struct glfs_ra_page *tmp = NULL;
 
-	size = iov_copy (iovec, iovcnt, iov, cnt); /* FIXME!!! */
+	list_for_each_entry_safe (page, tmp, &ra->pages, list) {
+		list_del_init (&page->list);
+		if (page->ready)
+			glfs_ra_page_free (page);
+		else
+			page->stale = 1;
+	}
 
-	glfd->offset = (offset + size);
+	ra->npages = 0;
+	ra->eof = -1;
+}
 
-	if (iov)
-		GF_FREE (iov);
-	if (iobref)
-		iobref_unref (iobref);
 
-	ret = size;
-out:
-	if (fd)
-		fd_unref (fd);
+/* Drops the pages which end at or before @offset */
+static void
+__glfs_ra_prune (struct glfs_ra *ra, off_t offset)
+{
+	struct glfs_ra_page *page = NULL;
+	struct glfs_ra_page *tmp = NULL;
 
-	glfs_subvol_done (glfd->fs, subvol);
+	list_for_each_entry_safe (page, tmp, &ra->pages, list) {
+		if (page->offset + page->size > offset)
+			break;
 
-	return ret;
+		list_del_init (&page->list);
+		ra->npages--;
+		if (page->ready)
+			glfs_ra_page_free (page);
+		else
+			page->stale = 1;
+	}
 }
 
 
-ssize_t
-glfs_read (struct glfs_fd *glfd, void *buf, size_t count, int flags)
+static void
+glfs_ra_page_done (struct glfs_ra_page *page, ssize_t ret,
+		   struct iovec *vector, int count, struct iobref *iobref)
 {
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+	struct glfs_ra *ra = NULL;
 
-	iov.iov_base = buf;
-	iov.iov_len = count;
+	ra = page->ra;
 
-	ret = glfs_preadv (glfd, &iov, 1, glfd->offset, flags);
+	if (page->fd) {
+		fd_unref (page->fd);
+		page->fd = NULL;
+	}
 
-	return ret;
-}
+	if (page->subvol) {
+		glfs_subvol_done (ra->fs, page->subvol);
+		page->subvol = NULL;
+	}
 
+	pthread_mutex_lock (&ra->mutex);
+	{
+		ra->inflight--;
 
-ssize_t
-glfs_pread (struct glfs_fd *glfd, void *buf, size_t count, off_t offset,
-	    int flags)
-{
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+		if (page->stale) {
+			glfs_ra_page_free (page);
+			goto unlock;
+		}
 
-	iov.iov_base = buf;
-	iov.iov_len = count;
+		if (ret > 0) {
+			page->iov = iov_dup (vector, count);
+			if (page->iov) {
+				page->count = count;
+				page->iobref = iobref_ref (iobref);
+			} else {
+				ret = -1;
+			}
+		}
 
-	ret = glfs_preadv (glfd, &iov, 1, offset, flags);
+		page->ret = ret;
+		page->ready = 1;
 
-	return ret;
+		if (ret >= 0 && ret < page->size &&
+		    (ra->eof == -1 || page->offset + ret < ra->eof))
+			ra->eof = page->offset + ret;
+	}
+unlock:
+	pthread_cond_broadcast (&ra->cond);
+	pthread_mutex_unlock (&ra->mutex);
 }
 
 
-ssize_t
-glfs_readv (struct glfs_fd *glfd, const struct iovec *iov, int count,
-	    int flags)
+static int
+glfs_ra_readv_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		   int32_t op_ret, int32_t op_errno, struct iovec *vector,
+		   int32_t count, struct iatt *stbuf, struct iobref *iobref,
+		   dict_t *xdata)
 {
-	ssize_t      ret = 0;
+	struct glfs_ra_page *page = NULL;
+	struct glfs         *fs = NULL;
 
-	ret = glfs_preadv (glfd, iov, count, glfd->offset, flags);
+	page = frame->local;
+	frame->local = NULL;
+	fs = page->ra->fs;
 
-	return ret;
-}
+	glfs_ra_page_done (page, op_ret, vector, count, iobref);
 
+	glfs_bg_frame_destroy (fs, frame);
 
-struct glfs_io {
-	struct glfs_fd      *glfd;
-	int                  op;
-	off_t                offset;
-	struct iovec        *iov;
-	int                  count;
-	int                  flags;
-	glfs_io_cbk          fn;
-	void                *data;
-};
+	return 0;
+}
 
 
-static int
-glfs_io_async_cbk (int ret, call_frame_t *frame, void *data)
+/* Queues new pages on @winds until the window covers @end and holds
+   the configured number of pages. They are wound by glfs_ra_wind(),
+   after @ra->mutex is released.
+*/
+static void
+__glfs_ra_fill (struct glfs_ra *ra, off_t end, struct list_head *winds)
 {
-	struct glfs_io  *gio = data;
+	struct glfs_ra_page *page = NULL;
+	struct glfs         *fs = NULL;
 
-	gio->fn (gio->glfd, ret, gio->data);
+	fs = ra->fs;
 
-	GF_FREE (gio->iov);
-	GF_FREE (gio);
+	while (ra->npages < fs->ra_pages || ra->next < end) {
+		if (ra->eof != -1 && ra->next >= ra->eof)
+			break;
 
-	return 0;
+		page = GF_CALLOC (1, sizeof (*page), glfs_mt_glfs_ra_page_t);
+		if (!page)
+			break;
+
+		page->ra = ra;
+		page->offset = ra->next;
+		page->size = fs->ra_page_size;
+		INIT_LIST_HEAD (&page->wind_list);
+
+		list_add_tail (&page->list, &ra->pages);
+		list_add_tail (&page->wind_list, winds);
+
+		ra->next += page->size;
+		ra->npages++;
+		ra->inflight++;
+	}
 }
 
 
-static int
-glfs_io_async_task (void *data)
+static void
+glfs_ra_wind (struct glfs_ra *ra, xlator_t *subvol, fd_t *fd,
+	      struct list_head *winds)
 {
-	struct glfs_io *gio = data;
-	ssize_t         ret = 0;
+	struct glfs_ra_page *page = NULL;
+	struct glfs_ra_page *tmp = NULL;
+	call_frame_t        *frame = NULL;
 
-	switch (gio->op) {
-	case GF_FOP_READ:
-		ret = glfs_preadv (gio->glfd, gio->iov, gio->count,
-				   gio->offset, gio->flags);
-		break;
-	case GF_FOP_WRITE:
-		ret = glfs_pwritev (gio->glfd, gio->iov, gio->count,
-				    gio->offset, gio->flags);
-		break;
-	case GF_FOP_FTRUNCATE:
-		ret = glfs_ftruncate (gio->glfd, gio->offset);
-		break;
-	case GF_FOP_FSYNC:
-		if (gio->flags)
-			ret = glfs_fdatasync (gio->glfd);
-		else
-			ret = glfs_fsync (gio->glfd);
-		break;
-	case GF_FOP_DISCARD:
-		ret = glfs_discard (gio->glfd, gio->offset, gio->count);
-		break;
-	}
+	list_for_each_entry_safe (page, tmp, winds, wind_list) {
+		list_del_init (&page->wind_list);
+
+		frame = glfs_bg_frame_new (page->ra->fs);
+		if (!frame) {
+			glfs_ra_page_done (page, -1, NULL, 0, NULL);
+			continue;
+		}
 
-	return (int) ret;
+		page->subvol = glfs_subvol_hold (subvol);
+		page->fd = fd_ref (fd);
+		frame->local = page;
+
+		STACK_WIND (frame, glfs_ra_readv_cbk, subvol,
+			    subvol->fops->readv, fd, page->size,
+			    page->offset, 0, NULL);
+	}
 }
 
 
-int
-glfs_preadv_async (struct glfs_fd *glfd, const struct iovec *iovec, int count,
-		   off_t offset, int flags, glfs_io_cbk fn, void *data)
+/* Gathers the data of [@offset, @end) from ready pages. Returns -1
+   when it is not all there, with @waitp set if it is still in flight.
+*/
+static ssize_t
+__glfs_ra_collect (struct glfs_ra *ra, off_t offset, off_t end,
+		   struct iovec **iovp, int *cntp, struct iobref **iobrefp,
+		   int *waitp)
 {
-	struct glfs_io *gio = NULL;
-	int             ret = 0;
+	struct glfs_ra_page *page = NULL;
+	struct iovec        *iov = NULL;
+	struct iobref       *iobref = NULL;
+	off_t                pos = offset;
+	off_t                stop = 0;
+	int                  cnt = 0;
+	int                  eof = 0;
+
+	*waitp = 0;
+
+	list_for_each_entry (page, &ra->pages, list) {
+		if (pos >= end || eof)
+			break;
 
-	gio = GF_CALLOC (1, sizeof (*gio), glfs_mt_glfs_io_t);
-	if (!gio) {
-		errno = ENOMEM;
-		return -1;
+		if (page->offset > pos)
+			return -1;
+
+		if (!page->ready) {
+			*waitp = 1;
+			return -1;
+		}
+
+		/* errors are left for the bricks to report again */
+		if (page->ret < 0)
+			return -1;
+
+		if (page->ret < page->size)
+			eof = 1;
+
+		stop = min (page->offset + page->ret, end);
+		if (stop > pos) {
+			pos = stop;
+			cnt += page->count;
+		}
 	}
 
-	gio->iov = iov_dup (iovec, count);
-	if (!gio->iov) {
-		GF_FREE (gio);
-		errno = ENOMEM;
+	if (pos < end && !eof)
+		return -1;
+
+	if (pos == offset)
+		return 0;
+
+	iov = GF_CALLOC (cnt, sizeof (*iov), gf_common_mt_iovec);
+	if (!iov)
+		return -1;
+
+	iobref = iobref_new ();
+	if (!iobref) {
+		GF_FREE (iov);
 		return -1;
 	}
 
-	gio->op     = GF_FOP_READ;
-	gio->glfd   = glfd;
-	gio->count  = count;
-	gio->offset = offset;
-	gio->flags  = flags;
-	gio->fn     = fn;
-	gio->data   = data;
+	end = pos;
+	pos = offset;
+	cnt = 0;
 
-	ret = synctask_new (glfs_from_glfd (glfd)->ctx->env,
-			    glfs_io_async_task, glfs_io_async_cbk,
-			    NULL, gio);
+	list_for_each_entry (page, &ra->pages, list) {
+		if (pos >= end)
+			break;
 
-	if (ret) {
-		GF_FREE (gio->iov);
-		GF_FREE (gio);
+		stop = min (page->offset + page->ret, end);
+		if (stop <= pos)
+			continue;
+
+		cnt += iov_subset (page->iov, page->count,
+				   pos - page->offset, stop - page->offset,
+				   &iov[cnt]);
+		iobref_merge (iobref, page->iobref);
+		pos = stop;
 	}
 
-	return ret;
+	*iovp = iov;
+	*cntp = cnt;
+	*iobrefp = iobref;
+
+	return end - offset;
 }
 
 
-int
-glfs_read_async (struct glfs_fd *glfd, void *buf, size_t count, int flags,
-		 glfs_io_cbk fn, void *data)
+static struct glfs_ra *
+glfs_ra_get (struct glfs_fd *glfd)
 {
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+	struct glfs_ra *ra = NULL;
 
-	iov.iov_base = buf;
-	iov.iov_len = count;
+	LOCK (&glfd->lock);
+	{
+		if (glfd->ra)
+			goto unlock;
 
-	ret = glfs_preadv_async (glfd, &iov, 1, glfd->offset, flags, fn, data);
+		ra = GF_CALLOC (1, sizeof (*ra), glfs_mt_glfs_ra_t);
+		if (!ra)
+			goto unlock;
 
-	return ret;
+		ra->fs = glfd->fs;
+		pthread_mutex_init (&ra->mutex, NULL);
+		pthread_cond_init (&ra->cond, NULL);
+		INIT_LIST_HEAD (&ra->pages);
+		ra->eof = -1;
+		ra->expected = -1;
+
+		glfd->ra = ra;
+	}
+unlock:
+	ra = glfd->ra;
+	UNLOCK (&glfd->lock);
+
+	return ra;
 }
 
 
-int
-glfs_pread_async (struct glfs_fd *glfd, void *buf, size_t count, off_t offset,
-		  int flags, glfs_io_cbk fn, void *data)
+/*
+  Serve a read which continues the previous one on @glfd from the
+  read-ahead pages, keeping the window ahead of it full. Returns -1
+  when the read has to be sent to the bricks instead.
+
+  Any modification of the inode, through whichever glfd, path or
+  handle, changes its glfs_inode_gen() and drops the pages.
+*/
+static ssize_t
+glfs_ra_readv (struct glfs_fd *glfd, xlator_t *subvol, fd_t *fd,
+	       size_t size, off_t offset, struct iovec **iovp, int *cntp,
+	       struct iobref **iobrefp)
 {
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+	struct glfs_ra      *ra = NULL;
+	struct list_head     winds;
+	ssize_t              ret = -1;
+	off_t                end = 0;
+	int                  wait = 0;
+	uint64_t             gen = 0;
+
+	/* 0 when the inode ctx is missing, changes would go unnoticed */
+	gen = glfs_inode_gen (glfd->fs, fd->inode);
+	if (!gen)
+		return -1;
 
-	iov.iov_base = buf;
-	iov.iov_len = count;
+	ra = glfs_ra_get (glfd);
+	if (!ra)
+		return -1;
 
-	ret = glfs_preadv_async (glfd, &iov, 1, offset, flags, fn, data);
+	INIT_LIST_HEAD (&winds);
+	end = offset + size;
+
+	pthread_mutex_lock (&ra->mutex);
+	{
+		if (gen != ra->gen) {
+			__glfs_ra_drop (ra);
+			ra->gen = gen;
+		}
+
+		if (offset != ra->expected) {
+			__glfs_ra_drop (ra);
+			ra->expected = end;
+			goto unlock;
+		}
+
+		ra->expected = end;
+
+		__glfs_ra_prune (ra, offset);
+		if (list_empty (&ra->pages))
+			ra->next = offset;
+
+		__glfs_ra_fill (ra, end, &winds);
+	}
+	pthread_mutex_unlock (&ra->mutex);
+
+	glfs_ra_wind (ra, subvol, fd, &winds);
+
+	pthread_mutex_lock (&ra->mutex);
+	{
+		for (;;) {
+			ret = __glfs_ra_collect (ra, offset, end, iovp, cntp,
+						 iobrefp, &wait);
+			if (!wait)
+				break;
+			pthread_cond_wait (&ra->cond, &ra->mutex);
+		}
+
+		if (ret > 0)
+			__glfs_ra_prune (ra, offset + ret);
+	}
+unlock:
+	pthread_mutex_unlock (&ra->mutex);
 
 	return ret;
 }
 
 
-int
-glfs_readv_async (struct glfs_fd *glfd, const struct iovec *iov, int count,
-		  int flags, glfs_io_cbk fn, void *data)
+/* To be called on every modification of the file through @glfd, other
+   modifications are caught by glfs_inode_gen()
+*/
+void
+glfs_ra_invalidate (struct glfs_fd *glfd)
 {
-	ssize_t      ret = 0;
+	struct glfs_ra *ra = NULL;
 
-	ret = glfs_preadv_async (glfd, iov, count, glfd->offset, flags,
-				 fn, data);
-	return ret;
+	ra = glfd->ra;
+	if (!ra)
+		return;
+
+	pthread_mutex_lock (&ra->mutex);
+	{
+		__glfs_ra_drop (ra);
+	}
+	pthread_mutex_unlock (&ra->mutex);
 }
 
-///// writev /////
 
-ssize_t
-glfs_pwritev (struct glfs_fd *glfd, const struct iovec *iovec, int iovcnt,
-	      off_t offset, int flags)
+void
+glfs_ra_destroy (struct glfs_fd *glfd)
 {
-	xlator_t       *subvol = NULL;
-	int             ret = -1;
-	size_t          size = -1;
-	struct iobref  *iobref = NULL;
-	struct iobuf   *iobuf = NULL;
-	struct iovec    iov = {0, };
-	fd_t           *fd = NULL;
+	struct glfs_ra *ra = NULL;
 
-	__glfs_entry_fd (glfd);
+	ra = glfd->ra;
+	if (!ra)
+		return;
 
-	subvol = glfs_active_subvol (glfd->fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
+	pthread_mutex_lock (&ra->mutex);
+	{
+		__glfs_ra_drop (ra);
 
-	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
-	if (!fd) {
-		ret = -1;
-		errno = EBADFD;
-		goto out;
+		while (ra->inflight)
+			pthread_cond_wait (&ra->cond, &ra->mutex);
 	}
+	pthread_mutex_unlock (&ra->mutex);
 
-	size = iov_length (iovec, iovcnt);
+	pthread_mutex_destroy (&ra->mutex);
+	pthread_cond_destroy (&ra->cond);
+	GF_FREE (ra);
 
-	iobuf = iobuf_get2 (subvol->ctx->iobuf_pool, size);
-	if (!iobuf) {
-		ret = -1;
-		errno = ENOMEM;
-		goto out;
-	}
+	glfd->ra = NULL;
+}
 
-	iobref = iobref_new ();
-	if (!iobref) {
-		iobuf_unref (iobuf);
-		errno = ENOMEM;
-		ret = -1;
-		goto out;
-	}
 
-	ret = iobref_add (iobref, iobuf);
-	if (ret) {
-		iobuf_unref (iobuf);
-		iobref_unref (iobref);
-		errno = ENOMEM;
-		ret = -1;
-		goto out;
-	}
+///// write-behind /////
 
-	iov_unload (iobuf_ptr (iobuf), iovec, iovcnt);  /* FIXME!!! */
+struct glfs_io;
 
-	iov.iov_base = iobuf_ptr (iobuf);
-	iov.iov_len = size;
+static void glfs_io_wind_list (struct list_head *gios);
 
-	ret = syncop_writev (subvol, fd, &iov, 1, offset, iobref, flags);
+struct glfs_wb_req {
+	struct glfs_wb      *wb;
+	struct iobuf        *iobuf;
+	struct iobref       *iobref;
+	struct iovec         iov; /* data buffered so far */
+	off_t                offset;
+	xlator_t            *subvol;
+	fd_t                *fd;
+};
 
-	iobuf_unref (iobuf);
-	iobref_unref (iobref);
+struct glfs_wb {
+	struct glfs         *fs;
+	pthread_mutex_t      mutex;
+	pthread_cond_t       cond;
+	size_t               size; /* buffer size, flushed once full */
+	struct glfs_wb_req  *cur; /* buffer being filled */
+	int                  inflight; /* one buffer at most, for
+					 ordering, or the fops wound from
+					 @waiting */
+	struct list_head     waiting; /* glfs_io to be wound once the
+					 buffers are written, never
+					 non-empty with nothing inflight */
+	int                  op_errno; /* of a failed flush, not reported
+					  yet */
+};
 
-	if (ret <= 0)
-		goto out;
 
-	glfd->offset = (offset + size);
+static void
+glfs_wb_req_free (struct glfs_wb_req *req)
+{
+	if (req->iobref)
+		iobref_unref (req->iobref);
+	if (req->iobuf)
+		iobuf_unref (req->iobuf);
+	GF_FREE (req);
+}
 
-out:
-	if (fd)
-		fd_unref (fd);
 
-	glfs_subvol_done (glfd->fs, subvol);
+static struct glfs_wb_req *
+glfs_wb_req_new (struct glfs_wb *wb, off_t offset)
+{
+	struct glfs_wb_req *req = NULL;
 
-	return ret;
-}
+	req = GF_CALLOC (1, sizeof (*req), glfs_mt_glfs_wb_req_t);
+	if (!req)
+		return NULL;
 
+	req->wb = wb;
+	req->offset = offset;
 
-ssize_t
-glfs_write (struct glfs_fd *glfd, const void *buf, size_t count, int flags)
-{
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+	req->iobuf = iobuf_get2 (wb->fs->ctx->iobuf_pool, wb->size);
+	if (!req->iobuf)
+		goto err;
 
-	iov.iov_base = (void *) buf;
-	iov.iov_len = count;
+	req->iobref = iobref_new ();
+	if (!req->iobref)
+		goto err;
 
-	ret = glfs_pwritev (glfd, &iov, 1, glfd->offset, flags);
+	if (iobref_add (req->iobref, req->iobuf))
+		goto err;
 
-	return ret;
+	req->iov.iov_base = iobuf_ptr (req->iobuf);
+	req->iov.iov_len = 0;
+
+	return req;
+err:
+	glfs_wb_req_free (req);
+	return NULL;
 }
 
 
+static void glfs_wb_wind (struct glfs_wb_req *req, xlator_t *subvol,
+			  fd_t *fd);
+static struct glfs_wb_req *__glfs_wb_detach (struct glfs_wb *wb);
 
-ssize_t
-glfs_writev (struct glfs_fd *glfd, const struct iovec *iov, int count,
-	     int flags)
+
+static void __glfs_wb_resume (struct glfs_wb *wb, struct glfs_wb_req **nextp,
+			      xlator_t **subvolp, fd_t **fdp,
+			      struct list_head *gios);
+
+
+/* Drops one of @wb->inflight. Once none is left, the buffer filled
+   meanwhile is sent if asynchronous fops wait for it, or else the fops
+   themselves are wound. They stay counted in @wb->inflight until they
+   reply, so that a flush or a write does not overtake them. Runs from
+   the reply path, so never waits.
+*/
+static void
+glfs_wb_complete (struct glfs_wb *wb, int op_errno)
 {
-	ssize_t      ret = 0;
+	struct glfs_wb_req *next = NULL;
+	xlator_t           *subvol = NULL;
+	fd_t               *fd = NULL;
+	struct list_head    gios;
 
-	ret = glfs_pwritev (glfd, iov, count, glfd->offset, flags);
+	INIT_LIST_HEAD (&gios);
 
-	return ret;
-}
+	pthread_mutex_lock (&wb->mutex);
+	{
+		wb->inflight--;
 
+		if (op_errno && !wb->op_errno)
+			wb->op_errno = op_errno;
 
-ssize_t
-glfs_pwrite (struct glfs_fd *glfd, const void *buf, size_t count, off_t offset,
-	     int flags)
-{
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+		if (!wb->inflight && !list_empty (&wb->waiting))
+			__glfs_wb_resume (wb, &next, &subvol, &fd, &gios);
 
-	iov.iov_base = (void *) buf;
-	iov.iov_len = count;
+		pthread_cond_broadcast (&wb->cond);
+	}
+	pthread_mutex_unlock (&wb->mutex);
 
-	ret = glfs_pwritev (glfd, &iov, 1, offset, flags);
+	if (next)
+		glfs_wb_wind (next, subvol, fd);
 
-	return ret;
+	glfs_io_wind_list (&gios);
 }
 
 
-int
-glfs_pwritev_async (struct glfs_fd *glfd, const struct iovec *iovec, int count,
-		    off_t offset, int flags, glfs_io_cbk fn, void *data)
+static void
+glfs_wb_done (struct glfs_wb_req *req, int op_ret, int op_errno)
 {
-	struct glfs_io *gio = NULL;
-	int             ret = 0;
+	struct glfs_wb     *wb = NULL;
 
-	gio = GF_CALLOC (1, sizeof (*gio), glfs_mt_glfs_io_t);
-	if (!gio) {
-		errno = ENOMEM;
-		return -1;
-	}
+	wb = req->wb;
 
-	gio->iov = iov_dup (iovec, count);
-	if (!gio->iov) {
-		GF_FREE (gio);
-		errno = ENOMEM;
-		return -1;
+	if (req->fd) {
+		glfs_iatt_cache_invalidate (wb->fs, req->fd->inode);
+		fd_unref (req->fd);
 	}
 
-	gio->op     = GF_FOP_WRITE;
-	gio->glfd   = glfd;
-	gio->count  = count;
-	gio->offset = offset;
-	gio->flags  = flags;
-	gio->fn     = fn;
-	gio->data   = data;
+	if (req->subvol)
+		glfs_subvol_done (wb->fs, req->subvol);
 
-	ret = synctask_new (glfs_from_glfd (glfd)->ctx->env,
-			    glfs_io_async_task, glfs_io_async_cbk,
-			    NULL, gio);
+	if (op_ret >= 0 && op_ret < req->iov.iov_len)
+		op_errno = EIO;
+	else if (op_ret >= 0)
+		op_errno = 0;
 
-	if (ret) {
-		GF_FREE (gio->iov);
-		GF_FREE (gio);
-	}
+	glfs_wb_req_free (req);
 
-	return ret;
+	glfs_wb_complete (wb, op_errno);
 }
 
 
-int
-glfs_write_async (struct glfs_fd *glfd, const void *buf, size_t count, int flags,
-		  glfs_io_cbk fn, void *data)
+static int
+glfs_wb_writev_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		    int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+		    struct iatt *postbuf, dict_t *xdata)
 {
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+	struct glfs_wb_req *req = NULL;
+	struct glfs        *fs = NULL;
 
-	iov.iov_base = (void *) buf;
-	iov.iov_len = count;
+	req = frame->local;
+	frame->local = NULL;
+	fs = req->wb->fs;
 
-	ret = glfs_pwritev_async (glfd, &iov, 1, glfd->offset, flags, fn, data);
+	glfs_wb_done (req, op_ret, op_errno);
 
-	return ret;
+	glfs_bg_frame_destroy (fs, frame);
+
+	return 0;
 }
 
 
-int
-glfs_pwrite_async (struct glfs_fd *glfd, const void *buf, int count,
-		   off_t offset, int flags, glfs_io_cbk fn, void *data)
+/* Sends a buffer detached from @wb->cur, without @wb->mutex held */
+static void
+glfs_wb_wind (struct glfs_wb_req *req, xlator_t *subvol, fd_t *fd)
 {
-	struct iovec iov = {0, };
-	ssize_t      ret = 0;
+	call_frame_t *frame = NULL;
 
-	iov.iov_base = (void *) buf;
-	iov.iov_len = count;
+	frame = glfs_bg_frame_new (req->wb->fs);
+	if (!frame) {
+		glfs_wb_done (req, -1, ENOMEM);
+		return;
+	}
 
-	ret = glfs_pwritev_async (glfd, &iov, 1, offset, flags, fn, data);
+	req->subvol = glfs_subvol_hold (subvol);
+	req->fd = fd_ref (fd);
+	frame->local = req;
 
-	return ret;
+	STACK_WIND (frame, glfs_wb_writev_cbk, subvol, subvol->fops->writev,
+		    fd, &req->iov, 1, req->offset, 0, req->iobref, NULL);
 }
 
 
-int
-glfs_writev_async (struct glfs_fd *glfd, const struct iovec *iov, int count,
-		   int flags, glfs_io_cbk fn, void *data)
+static struct glfs_wb_req *
+__glfs_wb_detach (struct glfs_wb *wb)
 {
-	ssize_t      ret = 0;
+	struct glfs_wb_req *req = NULL;
 
-	ret = glfs_pwritev_async (glfd, iov, count, glfd->offset, flags,
-				  fn, data);
-	return ret;
+	req = wb->cur;
+	if (req)
+		wb->inflight++;
+	wb->cur = NULL;
+
+	return req;
 }
 
 
-int
-glfs_fsync (struct glfs_fd *glfd)
+/*
+  Buffer a write on @glfd. Returns the number of bytes buffered, 0 if
+  the write has to be sent right away (anything buffered earlier is on
+  the bricks by then), or -1 with the error of an earlier buffered write.
+*/
+static ssize_t
+glfs_wb_writev (struct glfs_fd *glfd, xlator_t *subvol, fd_t *fd,
+		const struct iovec *iovec, int iovcnt, off_t offset)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	fd_t            *fd = NULL;
+	struct glfs_wb      *wb = NULL;
+	struct glfs_wb_req  *req = NULL;
+	ssize_t              ret = 0;
+	size_t               size = 0;
 
-	__glfs_entry_fd (glfd);
+	wb = glfd->wb;
+	size = iov_length (iovec, iovcnt);
 
-	subvol = glfs_active_subvol (glfd->fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
+	pthread_mutex_lock (&wb->mutex);
+	{
+		if (wb->op_errno) {
+			errno = wb->op_errno;
+			wb->op_errno = 0;
+			ret = -1;
+			goto unlock;
+		}
 
-	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
-	if (!fd) {
-		ret = -1;
-		errno = EBADFD;
-		goto out;
+		/* a buffer is sent only once the previous one is written,
+		   so that a rewrite of the same range cannot overtake it */
+		while (wb->cur &&
+		       (offset != wb->cur->offset + wb->cur->iov.iov_len ||
+			wb->cur->iov.iov_len + size > wb->size)) {
+			if (!wb->inflight) {
+				req = __glfs_wb_detach (wb);
+				break;
+			}
+			pthread_cond_wait (&wb->cond, &wb->mutex);
+		}
+
+		/* asynchronous fops issued earlier go first */
+		if (!list_empty (&wb->waiting))
+			goto unlock;
+
+		if (!size || size >= wb->size)
+			goto unlock;
+
+		if (!wb->cur) {
+			wb->cur = glfs_wb_req_new (wb, offset);
+			if (!wb->cur)
+				goto unlock;
+		}
+
+		iov_unload ((char *) wb->cur->iov.iov_base +
+			    wb->cur->iov.iov_len, iovec, iovcnt);
+		wb->cur->iov.iov_len += size;
+		ret = size;
 	}
+unlock:
+	pthread_mutex_unlock (&wb->mutex);
 
-	ret = syncop_fsync (subvol, fd, 0);
-out:
-	if (fd)
-		fd_unref (fd);
+	if (req)
+		glfs_wb_wind (req, subvol, fd);
 
-	glfs_subvol_done (glfd->fs, subvol);
+	if (ret == 0)
+		glfs_wb_flush (glfd, subvol, fd);
 
 	return ret;
 }
 
 
-static int
-glfs_fsync_async_common (struct glfs_fd *glfd, glfs_io_cbk fn, void *data,
-			 int dataonly)
+/* Sends what @glfd has buffered and waits for all of it to be written */
+void
+glfs_wb_flush (struct glfs_fd *glfd, xlator_t *subvol, fd_t *fd)
 {
-	struct glfs_io *gio = NULL;
-	int             ret = 0;
+	struct glfs_wb      *wb = NULL;
+	struct glfs_wb_req  *req = NULL;
 
-	gio = GF_CALLOC (1, sizeof (*gio), glfs_mt_glfs_io_t);
-	if (!gio) {
-		errno = ENOMEM;
-		return -1;
+	wb = glfd->wb;
+	if (!wb)
+		return;
+
+	pthread_mutex_lock (&wb->mutex);
+	{
+		while (wb->inflight)
+			pthread_cond_wait (&wb->cond, &wb->mutex);
+
+		req = __glfs_wb_detach (wb);
 	}
+	pthread_mutex_unlock (&wb->mutex);
 
-	gio->op     = GF_FOP_FSYNC;
-	gio->glfd   = glfd;
-	gio->flags  = dataonly;
-	gio->fn     = fn;
-	gio->data   = data;
+	if (req)
+		glfs_wb_wind (req, subvol, fd);
 
-	ret = synctask_new (glfs_from_glfd (glfd)->ctx->env,
-			    glfs_io_async_task, glfs_io_async_cbk,
-			    NULL, gio);
+	pthread_mutex_lock (&wb->mutex);
+	{
+		while (wb->inflight)
+			pthread_cond_wait (&wb->cond, &wb->mutex);
+	}
+	pthread_mutex_unlock (&wb->mutex);
+}
 
-	if (ret) {
-		GF_FREE (gio->iov);
-		GF_FREE (gio);
+
+/* glfs_wb_flush() which also reports, once, the error of a buffered
+   write. To be called before anything that must observe those writes.
+*/
+int
+glfs_wb_sync (struct glfs_fd *glfd, xlator_t *subvol, fd_t *fd)
+{
+	struct glfs_wb *wb = NULL;
+	int             ret = 0;
+
+	wb = glfd->wb;
+	if (!wb)
+		return 0;
+
+	glfs_wb_flush (glfd, subvol, fd);
+
+	pthread_mutex_lock (&wb->mutex);
+	{
+		if (wb->op_errno) {
+			errno = wb->op_errno;
+			wb->op_errno = 0;
+			ret = -1;
+		}
 	}
+	pthread_mutex_unlock (&wb->mutex);
 
 	return ret;
-
 }
 
 
-int
-glfs_fsync_async (struct glfs_fd *glfd, glfs_io_cbk fn, void *data)
+/* Called once the fd is being released, buffered data not flushed by
+   then (only on errors) is dropped.
+*/
+void
+glfs_wb_destroy (struct glfs_fd *glfd)
 {
-	return glfs_fsync_async_common (glfd, fn, data, 0);
+	struct glfs_wb *wb = NULL;
+
+	wb = glfd->wb;
+	if (!wb)
+		return;
+
+	pthread_mutex_lock (&wb->mutex);
+	{
+		if (wb->cur) {
+			glfs_wb_req_free (wb->cur);
+			wb->cur = NULL;
+		}
+
+		while (wb->inflight)
+			pthread_cond_wait (&wb->cond, &wb->mutex);
+	}
+	pthread_mutex_unlock (&wb->mutex);
+
+	pthread_mutex_destroy (&wb->mutex);
+	pthread_cond_destroy (&wb->cond);
+	GF_FREE (wb);
+
+	glfd->wb = NULL;
 }
 
 
 int
-glfs_fdatasync (struct glfs_fd *glfd)
+glfs_fd_set_write_behind (struct glfs_fd *glfd, size_t size)
 {
-	int              ret = -1;
+	struct glfs_wb  *wb = NULL;
 	xlator_t        *subvol = NULL;
 	fd_t            *fd = NULL;
+	int              ret = -1;
 
 	__glfs_entry_fd (glfd);
 
-	subvol = glfs_active_subvol (glfd->fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
+	if (size && size < GLFS_WB_MIN_SIZE) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
-	if (!fd) {
+	if (glfd->wb) {
+		/* write out what was buffered with the old setting */
+		subvol = glfs_active_subvol (glfd->fs);
+		if (!subvol) {
+			errno = EIO;
+			goto out;
+		}
+
+		fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
+		if (!fd) {
+			errno = EBADFD;
+			goto out;
+		}
+
+		ret = glfs_wb_sync (glfd, subvol, fd);
+		if (ret)
+			goto out;
+
+		glfs_wb_destroy (glfd);
+	}
+
+	ret = 0;
+	if (!size)
+		goto out;
+
+	wb = GF_CALLOC (1, sizeof (*wb), glfs_mt_glfs_wb_t);
+	if (!wb) {
+		errno = ENOMEM;
 		ret = -1;
-		errno = EBADFD;
 		goto out;
 	}
 
-	ret = syncop_fsync (subvol, fd, 1);
+	wb->fs = glfd->fs;
+	wb->size = size;
+	pthread_mutex_init (&wb->mutex, NULL);
+	pthread_cond_init (&wb->cond, NULL);
+	INIT_LIST_HEAD (&wb->waiting);
+
+	glfd->wb = wb;
 out:
 	if (fd)
 		fd_unref (fd);
 
-	glfs_subvol_done (glfd->fs, subvol);
+	if (subvol)
+		glfs_subvol_done (glfd->fs, subvol);
 
 	return ret;
 }
 
 
-int
-glfs_fdatasync_async (struct glfs_fd *glfd, glfs_io_cbk fn, void *data)
-{
-	return glfs_fsync_async_common (glfd, fn, data, 1);
-}
-
+//////////////
 
-int
-glfs_ftruncate (struct glfs_fd *glfd, off_t offset)
+/*
+  Read @size bytes at @offset and return the data in the iobufs it
+  arrived in. On success (ret > 0) the caller owns @iovp and a ref
+  on @iobrefp.
+*/
+static ssize_t
+glfs_preadv_iobuf (struct glfs_fd *glfd, size_t size, off_t offset,
+		   int flags, struct iovec **iovp, int *cntp,
+		   struct iobref **iobrefp)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	fd_t            *fd = NULL;
-
-	__glfs_entry_fd (glfd);
+	xlator_t       *subvol = NULL;
+	ssize_t         ret = -1;
+	struct iovec   *iov = NULL;
+	int             cnt = 0;
+	struct iobref  *iobref = NULL;
+	fd_t           *fd = NULL;
 
 	subvol = glfs_active_subvol (glfd->fs);
 	if (!subvol) {
@@ -1033,10 +1385,32 @@ glfs_ftruncate (struct glfs_fd *glfd, off_t offset)
 		goto out;
 	}
 
-	ret = syncop_ftruncate (subvol, fd, offset);
-out:
-	if (fd)
-		fd_unref (fd);
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
+	ret = -1;
+	if (glfd->fs->ra_pages)
+		ret = glfs_ra_readv (glfd, subvol, fd, size, offset, &iov,
+				     &cnt, &iobref);
+	if (ret < 0)
+		ret = syncop_readv (subvol, fd, size, offset, 0, &iov, &cnt,
+				    &iobref);
+	if (ret <= 0) {
+		GF_FREE (iov);
+		if (iobref)
+			iobref_unref (iobref);
+		goto out;
+	}
+
+	glfd->offset = (offset + ret);
+
+	*iovp = iov;
+	*cntp = cnt;
+	*iobrefp = iobref;
+out:
+	if (fd)
+		fd_unref (fd);
 
 	glfs_subvol_done (glfd->fs, subvol);
 
@@ -1044,278 +1418,2247 @@ out:
 }
 
 
-int
-glfs_ftruncate_async (struct glfs_fd *glfd, off_t offset,
-		      glfs_io_cbk fn, void *data)
+ssize_t
+glfs_preadv (struct glfs_fd *glfd, const struct iovec *iovec, int iovcnt,
+	     off_t offset, int flags)
 {
-	struct glfs_io *gio = NULL;
-	int             ret = 0;
+	ssize_t         ret = -1;
+	ssize_t         size = -1;
+	struct iovec   *iov = NULL;
+	int             cnt = 0;
+	struct iobref  *iobref = NULL;
 
-	gio = GF_CALLOC (1, sizeof (*gio), glfs_mt_glfs_io_t);
-	if (!gio) {
-		errno = ENOMEM;
+	__glfs_entry_fd (glfd);
+
+	size = iov_length (iovec, iovcnt);
+
+	ret = glfs_preadv_iobuf (glfd, size, offset, flags, &iov, &cnt,
+				 &iobref);
+	if (ret <= 0)
+		goto out;
+
+	/* Callers which can consume the iobufs directly should use
+	   glfs_preadv_zc() and avoid this copy.
+	*/
+	size = iov_copy (iovec, iovcnt, iov, cnt);
+
+	GF_FREE (iov);
+	iobref_unref (iobref);
+
+	ret = size;
+out:
+	return ret;
+}
+
+
+ssize_t
+glfs_preadv_zc (struct glfs_fd *glfd, size_t count, off_t offset, int flags,
+		const struct iovec **iovec, int *iovcnt, struct glfs_buf **bufp)
+{
+	ssize_t          ret = -1;
+	struct iovec    *iov = NULL;
+	int              cnt = 0;
+	struct iobref   *iobref = NULL;
+	struct glfs_buf *buf = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	if (!iovec || !iovcnt || !bufp) {
+		errno = EINVAL;
 		return -1;
 	}
 
-	gio->op     = GF_FOP_FTRUNCATE;
-	gio->glfd   = glfd;
-	gio->offset = offset;
-	gio->fn     = fn;
-	gio->data   = data;
+	*bufp = NULL;
+	*iovec = NULL;
+	*iovcnt = 0;
 
-	ret = synctask_new (glfs_from_glfd (glfd)->ctx->env,
-			    glfs_io_async_task, glfs_io_async_cbk,
-			    NULL, gio);
+	buf = GF_CALLOC (1, sizeof (*buf), glfs_mt_glfs_buf_t);
+	if (!buf) {
+		errno = ENOMEM;
+		return -1;
+	}
 
-	if (ret) {
-		GF_FREE (gio->iov);
-		GF_FREE (gio);
+	ret = glfs_preadv_iobuf (glfd, count, offset, flags, &iov, &cnt,
+				 &iobref);
+	if (ret <= 0) {
+		GF_FREE (buf);
+		return ret;
 	}
 
+	buf->iov = iov;
+	buf->count = cnt;
+	buf->iobref = iobref;
+
+	*iovec = iov;
+	*iovcnt = cnt;
+	*bufp = buf;
+
 	return ret;
 }
 
 
-int
-glfs_access (struct glfs *fs, const char *path, int mode)
+void
+glfs_buf_release (struct glfs_buf *buf)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            loc = {0, };
-	struct iatt      iatt = {0, };
-	int              reval = 0;
+	if (!buf)
+		return;
 
-	__glfs_entry_fs (fs);
+	GF_FREE (buf->iov);
+	if (buf->iobref)
+		iobref_unref (buf->iobref);
+	GF_FREE (buf);
+}
 
-	subvol = glfs_active_subvol (fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
-retry:
-	ret = glfs_resolve (fs, subvol, path, &loc, &iatt, reval);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+struct glfs_multi {
+	pthread_mutex_t      mutex;
+	pthread_cond_t       cond;
+	int                  pending;
+};
 
-	if (ret)
-		goto out;
 
-	ret = syncop_access (subvol, &loc, mode);
+static int
+glfs_preadv_multi_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		       int32_t op_ret, int32_t op_errno, struct iovec *vector,
+		       int32_t count, struct iatt *stbuf, struct iobref *iobref,
+		       dict_t *xdata)
+{
+	struct glfs_multi      *multi = NULL;
+	struct glfs_read_range *range = NULL;
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
-out:
-	loc_wipe (&loc);
+	multi = cookie;
+	range = frame->local;
+	frame->local = NULL;
 
-	glfs_subvol_done (fs, subvol);
+	if (op_ret < 0) {
+		range->ret = -1;
+		range->err = op_errno;
+	} else {
+		range->ret = iov_copy (range->iov, range->iovcnt, vector,
+				       count);
+		range->err = 0;
+	}
 
-	return ret;
+	/* before the caller is woken up, no frame outlives the call */
+	STACK_DESTROY (frame->root);
+
+	pthread_mutex_lock (&multi->mutex);
+	{
+		if (--multi->pending == 0)
+			pthread_cond_signal (&multi->cond);
+	}
+	pthread_mutex_unlock (&multi->mutex);
+
+	return 0;
 }
 
 
 int
-glfs_symlink (struct glfs *fs, const char *data, const char *path)
+glfs_preadv_multi (struct glfs_fd *glfd, struct glfs_read_range *ranges,
+		   int nr, int flags)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            loc = {0, };
-	struct iatt      iatt = {0, };
-	uuid_t           gfid;
-	dict_t          *xattr_req = NULL;
-	int              reval = 0;
+	xlator_t           *subvol = NULL;
+	fd_t               *fd = NULL;
+	call_frame_t       *frame = NULL;
+	struct glfs_multi   multi;
+	size_t              size = 0;
+	int                 ret = -1;
+	int                 i = 0;
 
-	__glfs_entry_fs (fs);
+	__glfs_entry_fd (glfd);
 
-	subvol = glfs_active_subvol (fs);
+	if (nr < 0 || (nr && !ranges)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	subvol = glfs_active_subvol (glfd->fs);
 	if (!subvol) {
-		ret = -1;
 		errno = EIO;
 		goto out;
 	}
 
-	xattr_req = dict_new ();
-	if (!xattr_req) {
-		ret = -1;
-		errno = ENOMEM;
+	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
+	if (!fd) {
+		errno = EBADFD;
 		goto out;
 	}
 
-	uuid_generate (gfid);
-	ret = dict_set_static_bin (xattr_req, "gfid-req", gfid, 16);
-	if (ret) {
-		ret = -1;
-		errno = ENOMEM;
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
 		goto out;
-	}
-retry:
-	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	pthread_mutex_init (&multi.mutex, NULL);
+	pthread_cond_init (&multi.cond, NULL);
+	multi.pending = nr;
 
-	if (loc.inode) {
-		errno = EEXIST;
-		ret = -1;
-		goto out;
-	}
+	for (i = 0; i < nr; i++) {
+		ranges[i].ret = 0;
+		ranges[i].err = 0;
 
-	if (ret == -1 && errno != ENOENT)
-		/* Any other type of error is fatal */
-		goto out;
+		size = iov_length (ranges[i].iov, ranges[i].iovcnt);
 
-	if (ret == -1 && errno == ENOENT && !loc.parent)
-		/* The parent directory or an ancestor even
-		   higher does not exist
-		*/
-		goto out;
+		frame = NULL;
+		if (size)
+			frame = syncop_create_frame (THIS);
 
-	/* ret == -1 && errno == ENOENT */
-	loc.inode = inode_new (loc.parent->table);
-	if (!loc.inode) {
-		ret = -1;
-		errno = ENOMEM;
-		goto out;
+		if (!frame) {
+			if (size) {
+				ranges[i].ret = -1;
+				ranges[i].err = ENOMEM;
+			}
+
+			pthread_mutex_lock (&multi.mutex);
+			multi.pending--;
+			pthread_mutex_unlock (&multi.mutex);
+			continue;
+		}
+
+		frame->local = &ranges[i];
+
+		STACK_WIND_COOKIE (frame, glfs_preadv_multi_cbk, &multi,
+				   subvol, subvol->fops->readv, fd, size,
+				   ranges[i].offset, flags, NULL);
 	}
 
-	ret = syncop_symlink (subvol, &loc, data, xattr_req, &iatt);
+	pthread_mutex_lock (&multi.mutex);
+	{
+		while (multi.pending)
+			pthread_cond_wait (&multi.cond, &multi.mutex);
+	}
+	pthread_mutex_unlock (&multi.mutex);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	pthread_mutex_destroy (&multi.mutex);
+	pthread_cond_destroy (&multi.cond);
 
-	if (ret == 0)
-		ret = glfs_loc_link (&loc, &iatt);
+	ret = 0;
+	for (i = 0; i < nr; i++) {
+		if (ranges[i].ret < 0) {
+			errno = EIO;
+			ret = -1;
+		}
+	}
 out:
-	loc_wipe (&loc);
-
-	if (xattr_req)
-		dict_unref (xattr_req);
+	if (fd)
+		fd_unref (fd);
 
-	glfs_subvol_done (fs, subvol);
+	glfs_subvol_done (glfd->fs, subvol);
 
 	return ret;
 }
 
 
-int
-glfs_readlink (struct glfs *fs, const char *path, char *buf, size_t bufsiz)
+ssize_t
+glfs_read (struct glfs_fd *glfd, void *buf, size_t count, int flags)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            loc = {0, };
-	struct iatt      iatt = {0, };
-	int              reval = 0;
-	char            *linkval = NULL;
-
-	__glfs_entry_fs (fs);
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
 
-	subvol = glfs_active_subvol (fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
-retry:
-	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+	iov.iov_base = buf;
+	iov.iov_len = count;
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	ret = glfs_preadv (glfd, &iov, 1, glfd->offset, flags);
 
-	if (ret)
-		goto out;
+	return ret;
+}
 
-	if (iatt.ia_type != IA_IFLNK) {
-		ret = -1;
-		errno = EINVAL;
-		goto out;
-	}
 
-	ret = syncop_readlink (subvol, &loc, &linkval, bufsiz);
-	if (ret > 0) {
-		memcpy (buf, linkval, ret);
-		GF_FREE (linkval);
-	}
+ssize_t
+glfs_pread (struct glfs_fd *glfd, void *buf, size_t count, off_t offset,
+	    int flags)
+{
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
-out:
-	loc_wipe (&loc);
+	iov.iov_base = buf;
+	iov.iov_len = count;
 
-	glfs_subvol_done (fs, subvol);
+	ret = glfs_preadv (glfd, &iov, 1, offset, flags);
 
 	return ret;
 }
 
 
-int
-glfs_mknod (struct glfs *fs, const char *path, mode_t mode, dev_t dev)
+ssize_t
+glfs_readv (struct glfs_fd *glfd, const struct iovec *iov, int count,
+	    int flags)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            loc = {0, };
-	struct iatt      iatt = {0, };
-	uuid_t           gfid;
-	dict_t          *xattr_req = NULL;
-	int              reval = 0;
+	ssize_t      ret = 0;
 
-	__glfs_entry_fs (fs);
+	ret = glfs_preadv (glfd, iov, count, glfd->offset, flags);
 
-	subvol = glfs_active_subvol (fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
+	return ret;
+}
 
-	xattr_req = dict_new ();
-	if (!xattr_req) {
-		ret = -1;
-		errno = ENOMEM;
-		goto out;
-	}
 
-	uuid_generate (gfid);
-	ret = dict_set_static_bin (xattr_req, "gfid-req", gfid, 16);
+/* Context of an *_async() call. The fop is wound directly from the
+   caller's thread, or, with write-behind buffers still to be written,
+   from their reply path. Only the user's glfs_io_cbk runs in a
+   synctask, where it may make synchronous calls.
+*/
+struct glfs_io {
+	struct list_head     list; /* in @glfd->wb->waiting */
+	void               (*wind) (struct glfs_io *gio);
+	struct glfs_fd      *glfd;
+	xlator_t            *subvol;
+	fd_t                *fd;
+	call_frame_t        *frame;
+	int                  op;
+	off_t                offset;
+	size_t               size; /* of a read, or length of a discard */
+	int                  flags; /* of a read or write, dataonly of
+				       an fsync */
+	struct iovec        *iov;
+	int                  count;
+	struct iovec         wvec; /* of a write, in @iobref */
+	struct iobref       *iobref;
+	glfs_io_cbk          fn;
+	void                *data;
+	struct glfs_wb      *wb; /* whose @inflight counts @gio, once
+				    wound from @waiting */
+	ssize_t              ret; /* for @fn */
+	int                  op_errno; /* for @fn, or of a failed setup */
+};
+
+
+/* Drops everything @gio holds, but not @gio itself */
+static void
+glfs_io_release (struct glfs_io *gio)
+{
+	if (gio->frame) {
+		gio->frame->local = NULL;
+		glfs_bg_frame_destroy (gio->glfd->fs, gio->frame);
+		gio->frame = NULL;
+	}
+
+	if (gio->fd) {
+		fd_unref (gio->fd);
+		gio->fd = NULL;
+	}
+
+	glfs_subvol_done (gio->glfd->fs, gio->subvol);
+	gio->subvol = NULL;
+
+	if (gio->iobref) {
+		iobref_unref (gio->iobref);
+		gio->iobref = NULL;
+	}
+
+	GF_FREE (gio->iov);
+	gio->iov = NULL;
+}
+
+
+static void
+glfs_io_destroy (struct glfs_io *gio)
+{
+	glfs_io_release (gio);
+	GF_FREE (gio);
+}
+
+
+static void glfs_io_done (struct glfs_io *gio, ssize_t ret, int op_errno);
+
+
+static void
+glfs_io_wind_list (struct list_head *gios)
+{
+	struct glfs_io *gio = NULL;
+	struct glfs_io *tmp = NULL;
+
+	list_for_each_entry_safe (gio, tmp, gios, list) {
+		list_del_init (&gio->list);
+		gio->wind (gio);
+	}
+}
+
+
+/* Called with @wb->mutex held, once nothing is inflight but fops wait.
+   A buffer filled meanwhile goes first, in @nextp with the subvol and fd
+   to write it to. Else the fops move to @gios, counted inflight.
+*/
+static void
+__glfs_wb_resume (struct glfs_wb *wb, struct glfs_wb_req **nextp,
+		  xlator_t **subvolp, fd_t **fdp, struct list_head *gios)
+{
+	struct glfs_io *gio = NULL;
+
+	gio = list_entry (wb->waiting.next, struct glfs_io, list);
+
+	if (wb->cur) {
+		/* @gio stays queued, and with it its subvol and fd */
+		*subvolp = gio->subvol;
+		*fdp = gio->fd;
+		*nextp = __glfs_wb_detach (wb);
+		return;
+	}
+
+	list_for_each_entry (gio, &wb->waiting, list) {
+		gio->wb = wb;
+		wb->inflight++;
+	}
+
+	list_splice_init (&wb->waiting, gios);
+}
+
+
+/* Winds @gio with @wind, or queues it behind the write-behind buffers
+   of its glfd, which keeps the ordering with them without waiting.
+*/
+static void
+glfs_io_wind (struct glfs_io *gio, void (*wind) (struct glfs_io *gio))
+{
+	struct glfs_wb     *wb = NULL;
+	struct glfs_wb_req *req = NULL;
+	int                 queued = 0;
+
+	gio->wind = wind;
+
+	if (gio->op_errno) {
+		/* reported through @gio->fn, like any other failure */
+		glfs_io_done (gio, -1, gio->op_errno);
+		return;
+	}
+
+	wb = gio->glfd->wb;
+	if (wb) {
+		pthread_mutex_lock (&wb->mutex);
+		{
+			if (wb->cur || wb->inflight) {
+				list_add_tail (&gio->list, &wb->waiting);
+				queued = 1;
+				if (!wb->inflight)
+					req = __glfs_wb_detach (wb);
+			}
+		}
+		pthread_mutex_unlock (&wb->mutex);
+	}
+
+	if (req)
+		glfs_wb_wind (req, gio->subvol, gio->fd);
+
+	if (!queued)
+		wind (gio);
+}
+
+
+/* Resolve the subvol and fd of @glfd and set up the frame to wind the
+   fop with. NULL, with @errno set, only when out of memory. Other
+   failures are kept in @op_errno and reported to @fn by glfs_io_wind().
+*/
+static struct glfs_io *
+glfs_io_new (struct glfs_fd *glfd, int op, glfs_io_cbk fn, void *data)
+{
+	struct glfs_io *gio = NULL;
+
+	gio = GF_CALLOC (1, sizeof (*gio), glfs_mt_glfs_io_t);
+	if (!gio) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	INIT_LIST_HEAD (&gio->list);
+	gio->op     = op;
+	gio->glfd   = glfd;
+	gio->fn     = fn;
+	gio->data   = data;
+
+	gio->subvol = glfs_active_subvol (glfd->fs);
+	if (!gio->subvol) {
+		gio->op_errno = EIO;
+		goto out;
+	}
+
+	gio->fd = glfs_resolve_fd (glfd->fs, gio->subvol, glfd);
+	if (!gio->fd) {
+		gio->op_errno = EBADFD;
+		goto out;
+	}
+
+	gio->frame = glfs_bg_frame_new (glfd->fs);
+	if (!gio->frame) {
+		gio->op_errno = ENOMEM;
+		goto out;
+	}
+
+	gio->frame->local = gio;
+out:
+	return gio;
+}
+
+
+static int
+glfs_io_cbk_task (void *opaque)
+{
+	struct glfs_io *gio = NULL;
+
+	gio = opaque;
+
+	if (gio->ret < 0)
+		errno = gio->op_errno;
+
+	gio->fn (gio->glfd, gio->ret, gio->data);
+
+	return 0;
+}
+
+
+static int
+glfs_io_cbk_task_done (int ret, call_frame_t *frame, void *opaque)
+{
+	GF_FREE (opaque);
+
+	return 0;
+}
+
+
+/* Runs from the reply path, which must not block. @fn is handed to a
+   synctask instead, where it may call into gfapi synchronously, close
+   @glfd included.
+*/
+static void
+glfs_io_done (struct glfs_io *gio, ssize_t ret, int op_errno)
+{
+	if (gio->wb)
+		glfs_wb_complete (gio->wb, 0);
+
+	/* release everything first, @fn may well close @glfd */
+	glfs_io_release (gio);
+
+	gio->ret = ret;
+	gio->op_errno = op_errno;
+
+	if (synctask_new (gio->glfd->fs->ctx->env, glfs_io_cbk_task,
+			  glfs_io_cbk_task_done, NULL, gio) == 0)
+		return;
+
+	/* out of memory, better late than never */
+	glfs_io_cbk_task (gio);
+	GF_FREE (gio);
+}
+
+
+static int
+glfs_io_async_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		   int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+		   struct iatt *postbuf, dict_t *xdata)
+{
+	struct glfs_io *gio = NULL;
+
+	gio = frame->local;
+
+	if (gio->op == GF_FOP_WRITE && op_ret > 0)
+		gio->glfd->offset = (gio->offset + op_ret);
+
+	if (gio->op != GF_FOP_FSYNC) {
+		glfs_iatt_cache_invalidate (gio->glfd->fs, gio->fd->inode);
+		glfs_ra_invalidate (gio->glfd);
+	}
+
+	glfs_io_done (gio, op_ret, op_errno);
+
+	return 0;
+}
+
+
+static int
+glfs_preadv_async_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		       int32_t op_ret, int32_t op_errno, struct iovec *vector,
+		       int32_t count, struct iatt *stbuf, struct iobref *iobref,
+		       dict_t *xdata)
+{
+	struct glfs_io *gio = NULL;
+	ssize_t         ret = op_ret;
+
+	gio = frame->local;
+
+	if (op_ret > 0) {
+		ret = iov_copy (gio->iov, gio->count, vector, count);
+		gio->glfd->offset = (gio->offset + ret);
+	}
+
+	glfs_io_done (gio, ret, op_errno);
+
+	return 0;
+}
+
+
+static void
+glfs_preadv_async_wind (struct glfs_io *gio)
+{
+	STACK_WIND (gio->frame, glfs_preadv_async_cbk, gio->subvol,
+		    gio->subvol->fops->readv, gio->fd, gio->size,
+		    gio->offset, gio->flags, NULL);
+}
+
+
+int
+glfs_preadv_async (struct glfs_fd *glfd, const struct iovec *iovec, int count,
+		   off_t offset, int flags, glfs_io_cbk fn, void *data)
+{
+	struct glfs_io *gio = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	gio = glfs_io_new (glfd, GF_FOP_READ, fn, data);
+	if (!gio)
+		return -1;
+
+	gio->iov = iov_dup (iovec, count);
+	if (!gio->iov) {
+		glfs_io_destroy (gio);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	gio->count  = count;
+	gio->offset = offset;
+	gio->size   = iov_length (iovec, count);
+	gio->flags  = flags;
+
+	glfs_io_wind (gio, glfs_preadv_async_wind);
+
+	return 0;
+}
+
+
+int
+glfs_read_async (struct glfs_fd *glfd, void *buf, size_t count, int flags,
+		 glfs_io_cbk fn, void *data)
+{
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+
+	ret = glfs_preadv_async (glfd, &iov, 1, glfd->offset, flags, fn, data);
+
+	return ret;
+}
+
+
+int
+glfs_pread_async (struct glfs_fd *glfd, void *buf, size_t count, off_t offset,
+		  int flags, glfs_io_cbk fn, void *data)
+{
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+
+	ret = glfs_preadv_async (glfd, &iov, 1, offset, flags, fn, data);
+
+	return ret;
+}
+
+
+int
+glfs_readv_async (struct glfs_fd *glfd, const struct iovec *iov, int count,
+		  int flags, glfs_io_cbk fn, void *data)
+{
+	ssize_t      ret = 0;
+
+	ret = glfs_preadv_async (glfd, iov, count, glfd->offset, flags,
+				 fn, data);
+	return ret;
+}
+
+///// writev /////
+
+/*
+  Write @iovec, which must already be backed by iobufs pinned by @iobref,
+  without copying it.
+*/
+static ssize_t
+glfs_pwritev_iobuf (struct glfs_fd *glfd, struct iovec *iovec, int iovcnt,
+		    struct iobref *iobref, off_t offset, int flags)
+{
+	xlator_t       *subvol = NULL;
+	int             ret = -1;
+	size_t          size = -1;
+	fd_t           *fd = NULL;
+
+	subvol = glfs_active_subvol (glfd->fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+
+	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
+	if (!fd) {
+		ret = -1;
+		errno = EBADFD;
+		goto out;
+	}
+
+	size = iov_length (iovec, iovcnt);
+
+	ret = 0;
+	if (glfd->wb && !(flags & (O_SYNC|O_DSYNC)))
+		ret = glfs_wb_writev (glfd, subvol, fd, iovec, iovcnt, offset);
+	if (ret == 0)
+		ret = syncop_writev (subvol, fd, iovec, iovcnt, offset, iobref,
+				     flags);
+	glfs_iatt_cache_invalidate (glfd->fs, fd->inode);
+	glfs_ra_invalidate (glfd);
+	if (ret <= 0)
+		goto out;
+
+	glfd->offset = (offset + size);
+
+out:
+	if (fd)
+		fd_unref (fd);
+
+	glfs_subvol_done (glfd->fs, subvol);
+
+	return ret;
+}
+
+
+ssize_t
+glfs_pwritev (struct glfs_fd *glfd, const struct iovec *iovec, int iovcnt,
+	      off_t offset, int flags)
+{
+	int             ret = -1;
+	size_t          size = -1;
+	struct iobref  *iobref = NULL;
+	struct iobuf   *iobuf = NULL;
+	struct iovec    iov = {0, };
+
+	__glfs_entry_fd (glfd);
+
+	size = iov_length (iovec, iovcnt);
+
+	iobuf = iobuf_get2 (glfd->fs->ctx->iobuf_pool, size);
+	if (!iobuf) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+
+	iobref = iobref_new ();
+	if (!iobref) {
+		iobuf_unref (iobuf);
+		errno = ENOMEM;
+		ret = -1;
+		goto out;
+	}
+
+	ret = iobref_add (iobref, iobuf);
+	if (ret) {
+		iobuf_unref (iobuf);
+		iobref_unref (iobref);
+		errno = ENOMEM;
+		ret = -1;
+		goto out;
+	}
+
+	/* Callers which can fill buffers from glfs_buf_alloc() should
+	   use glfs_pwrite_buf() and avoid this copy.
+	*/
+	iov_unload (iobuf_ptr (iobuf), iovec, iovcnt);
+
+	iov.iov_base = iobuf_ptr (iobuf);
+	iov.iov_len = size;
+
+	ret = glfs_pwritev_iobuf (glfd, &iov, 1, iobref, offset, flags);
+
+	iobuf_unref (iobuf);
+	iobref_unref (iobref);
+out:
+	return ret;
+}
+
+
+struct glfs_buf *
+glfs_buf_alloc (struct glfs *fs, size_t size, void **ptr)
+{
+	struct glfs_buf *buf = NULL;
+	struct iobuf    *iobuf = NULL;
+	int              ret = -1;
+
+	__glfs_entry_fs (fs);
+
+	if (!size || !ptr) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	buf = GF_CALLOC (1, sizeof (*buf), glfs_mt_glfs_buf_t);
+	if (!buf)
+		goto out;
+
+	buf->iov = GF_CALLOC (1, sizeof (*buf->iov), gf_common_mt_iovec);
+	if (!buf->iov)
+		goto out;
+	buf->count = 1;
+
+	iobuf = iobuf_get2 (fs->ctx->iobuf_pool, size);
+	if (!iobuf)
+		goto out;
+
+	buf->iobref = iobref_new ();
+	if (!buf->iobref)
+		goto out;
+
+	ret = iobref_add (buf->iobref, iobuf);
+	if (ret)
+		goto out;
+
+	buf->iov[0].iov_base = iobuf_ptr (iobuf);
+	buf->iov[0].iov_len = size;
+
+	*ptr = iobuf_ptr (iobuf);
+out:
+	/* @buf->iobref holds its own ref */
+	if (iobuf)
+		iobuf_unref (iobuf);
+
+	if (ret) {
+		glfs_buf_release (buf);
+		buf = NULL;
+		errno = ENOMEM;
+	}
+
+	return buf;
+}
+
+
+ssize_t
+glfs_pwrite_buf (struct glfs_fd *glfd, struct glfs_buf *buf, size_t count,
+		 off_t offset, int flags)
+{
+	ssize_t         ret = -1;
+	struct iovec   *iov = NULL;
+	int             cnt = 0;
+	size_t          len = 0;
+
+	__glfs_entry_fd (glfd);
+
+	if (!buf || count > iov_length (buf->iov, buf->count)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!count)
+		return 0;
+
+	if (count == iov_length (buf->iov, buf->count))
+		return glfs_pwritev_iobuf (glfd, buf->iov, buf->count,
+					   buf->iobref, offset, flags);
+
+	/* Only a prefix of @buf is to be written. Trim a copy of the
+	   vector, the data itself is still not copied.
+	*/
+	iov = iov_dup (buf->iov, buf->count);
+	if (!iov) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (cnt = 0; len < count; cnt++) {
+		if (iov[cnt].iov_len > count - len)
+			iov[cnt].iov_len = count - len;
+		len += iov[cnt].iov_len;
+	}
+
+	ret = glfs_pwritev_iobuf (glfd, iov, cnt, buf->iobref, offset, flags);
+
+	GF_FREE (iov);
+
+	return ret;
+}
+
+
+///// copy_file_range /////
+
+#define GLFS_COPY_CHUNK_SIZE   (128 * GF_UNIT_KB)
+#define GLFS_COPY_MAX_INFLIGHT 8
+
+struct glfs_copy {
+	pthread_mutex_t      mutex;
+	pthread_cond_t       cond;
+	xlator_t            *subvol;
+	fd_t                *fd_in;
+	fd_t                *fd_out;
+	off_t                off_in;
+	off_t                off_out;
+	int                  inflight;
+	off_t                limit; /* input offset the copy stops short at */
+	int                  op_errno;
+};
+
+struct glfs_copy_chunk {
+	struct glfs_copy    *copy;
+	off_t                offset; /* in the input file */
+	size_t               size;
+};
+
+
+static void
+glfs_copy_chunk_done (struct glfs_copy_chunk *chunk, ssize_t ret,
+		      int op_errno)
+{
+	struct glfs_copy *copy = NULL;
+	off_t             end = 0;
+
+	copy = chunk->copy;
+
+	pthread_mutex_lock (&copy->mutex);
+	{
+		if (ret < 0)
+			end = chunk->offset;
+		else
+			end = chunk->offset + ret;
+
+		if (end < chunk->offset + chunk->size && end < copy->limit) {
+			copy->limit = end;
+			if (ret < 0)
+				copy->op_errno = op_errno;
+		}
+
+		copy->inflight--;
+		pthread_cond_signal (&copy->cond);
+	}
+	pthread_mutex_unlock (&copy->mutex);
+
+	GF_FREE (chunk);
+}
+
+
+static int
+glfs_copy_writev_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		      int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+		      struct iatt *postbuf, dict_t *xdata)
+{
+	struct glfs_copy_chunk *chunk = NULL;
+
+	chunk = frame->local;
+	frame->local = NULL;
+
+	/* before the caller is woken up, no frame outlives the call */
+	STACK_DESTROY (frame->root);
+
+	glfs_copy_chunk_done (chunk, op_ret, op_errno);
+
+	return 0;
+}
+
+
+static int
+glfs_copy_readv_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		     int32_t op_ret, int32_t op_errno, struct iovec *vector,
+		     int32_t count, struct iatt *stbuf, struct iobref *iobref,
+		     dict_t *xdata)
+{
+	struct glfs_copy_chunk *chunk = NULL;
+	struct glfs_copy       *copy = NULL;
+
+	chunk = frame->local;
+	copy = chunk->copy;
+
+	if (op_ret <= 0) {
+		frame->local = NULL;
+		STACK_DESTROY (frame->root);
+		glfs_copy_chunk_done (chunk, op_ret, op_errno);
+		return 0;
+	}
+
+	/* the data goes back out in the iobufs it came in. A short read
+	   (end of file) ends up as a short write of the chunk */
+	STACK_WIND (frame, glfs_copy_writev_cbk, copy->subvol,
+		    copy->subvol->fops->writev, copy->fd_out, vector, count,
+		    copy->off_out + (chunk->offset - copy->off_in), 0,
+		    iobref, NULL);
+
+	return 0;
+}
+
+
+ssize_t
+glfs_copy_file_range (struct glfs_fd *glfd_in, off_t off_in,
+		      struct glfs_fd *glfd_out, off_t off_out, size_t len)
+{
+	xlator_t               *subvol = NULL;
+	fd_t                   *fd_in = NULL;
+	fd_t                   *fd_out = NULL;
+	call_frame_t           *frame = NULL;
+	struct glfs_copy        copy;
+	struct glfs_copy_chunk *chunk = NULL;
+	size_t                  pos = 0;
+	ssize_t                 ret = -1;
+
+	__glfs_entry_fd (glfd_in);
+
+	if (glfd_in->fs != glfd_out->fs) {
+		errno = EXDEV;
+		return -1;
+	}
+
+	if (off_in < 0 || off_out < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	subvol = glfs_active_subvol (glfd_in->fs);
+	if (!subvol) {
+		errno = EIO;
+		goto out;
+	}
+
+	fd_in = glfs_resolve_fd (glfd_in->fs, subvol, glfd_in);
+	fd_out = glfs_resolve_fd (glfd_out->fs, subvol, glfd_out);
+	if (!fd_in || !fd_out) {
+		errno = EBADFD;
+		goto out;
+	}
+
+	if (fd_in->inode == fd_out->inode &&
+	    off_in < off_out + len && off_out < off_in + len) {
+		errno = EINVAL;
+		goto out;
+	}
+
+	if (glfs_wb_sync (glfd_in, subvol, fd_in) ||
+	    glfs_wb_sync (glfd_out, subvol, fd_out))
+		goto out;
+
+	pthread_mutex_init (&copy.mutex, NULL);
+	pthread_cond_init (&copy.cond, NULL);
+	copy.subvol = subvol;
+	copy.fd_in = fd_in;
+	copy.fd_out = fd_out;
+	copy.off_in = off_in;
+	copy.off_out = off_out;
+	copy.inflight = 0;
+	copy.limit = off_in + len;
+	copy.op_errno = 0;
+
+	pthread_mutex_lock (&copy.mutex);
+	while (pos < len && off_in + pos < copy.limit) {
+		if (copy.inflight >= GLFS_COPY_MAX_INFLIGHT) {
+			pthread_cond_wait (&copy.cond, &copy.mutex);
+			continue;
+		}
+
+		chunk = GF_CALLOC (1, sizeof (*chunk), glfs_mt_glfs_copy_t);
+		frame = syncop_create_frame (THIS);
+		if (!chunk || !frame) {
+			GF_FREE (chunk);
+			if (frame)
+				STACK_DESTROY (frame->root);
+			copy.limit = off_in + pos;
+			copy.op_errno = ENOMEM;
+			break;
+		}
+
+		chunk->copy = &copy;
+		chunk->offset = off_in + pos;
+		chunk->size = min (len - pos, GLFS_COPY_CHUNK_SIZE);
+		frame->local = chunk;
+
+		pos += chunk->size;
+		copy.inflight++;
+
+		pthread_mutex_unlock (&copy.mutex);
+		{
+			STACK_WIND (frame, glfs_copy_readv_cbk, subvol,
+				    subvol->fops->readv, fd_in, chunk->size,
+				    chunk->offset, 0, NULL);
+		}
+		pthread_mutex_lock (&copy.mutex);
+	}
+
+	while (copy.inflight)
+		pthread_cond_wait (&copy.cond, &copy.mutex);
+	pthread_mutex_unlock (&copy.mutex);
+
+	pthread_mutex_destroy (&copy.mutex);
+	pthread_cond_destroy (&copy.cond);
+
+	glfs_iatt_cache_invalidate (glfd_out->fs, fd_out->inode);
+	glfs_ra_invalidate (glfd_out);
+
+	ret = copy.limit - off_in;
+	if (ret == 0 && copy.op_errno) {
+		errno = copy.op_errno;
+		ret = -1;
+	}
+out:
+	if (fd_in)
+		fd_unref (fd_in);
+	if (fd_out)
+		fd_unref (fd_out);
+
+	glfs_subvol_done (glfd_in->fs, subvol);
+
+	return ret;
+}
+
+
+///// sendfile /////
+
+#define GLFS_SENDFILE_CHUNK_SIZE (128 * GF_UNIT_KB)
+
+struct glfs_sendfile_chunk {
+	pthread_mutex_t      mutex;
+	pthread_cond_t       cond;
+	int                  busy;
+	ssize_t              ret;
+	int                  op_errno;
+	struct iovec        *iov;
+	int                  count;
+	struct iobref       *iobref;
+};
+
+
+static int
+glfs_sendfile_readv_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+			 int32_t op_ret, int32_t op_errno,
+			 struct iovec *vector, int32_t count,
+			 struct iatt *stbuf, struct iobref *iobref,
+			 dict_t *xdata)
+{
+	struct glfs_sendfile_chunk *chunk = NULL;
+
+	chunk = frame->local;
+	frame->local = NULL;
+
+	/* before the caller is woken up, no frame outlives the call. The
+	   reply is the caller's of the fop, not the frame's */
+	STACK_DESTROY (frame->root);
+
+	pthread_mutex_lock (&chunk->mutex);
+	{
+		chunk->ret = op_ret;
+		chunk->op_errno = op_errno;
+
+		if (op_ret > 0) {
+			chunk->iov = iov_dup (vector, count);
+			if (chunk->iov) {
+				chunk->count = count;
+				chunk->iobref = iobref_ref (iobref);
+			} else {
+				chunk->ret = -1;
+				chunk->op_errno = ENOMEM;
+			}
+		}
+
+		chunk->busy = 0;
+		pthread_cond_signal (&chunk->cond);
+	}
+	pthread_mutex_unlock (&chunk->mutex);
+
+	return 0;
+}
+
+
+static void
+glfs_sendfile_wind (struct glfs_sendfile_chunk *chunk, xlator_t *subvol,
+		    fd_t *fd, size_t size, off_t offset)
+{
+	call_frame_t *frame = NULL;
+
+	chunk->busy = 1;
+
+	frame = syncop_create_frame (THIS);
+	if (!frame) {
+		chunk->ret = -1;
+		chunk->op_errno = ENOMEM;
+		chunk->busy = 0;
+		return;
+	}
+
+	frame->local = chunk;
+
+	STACK_WIND (frame, glfs_sendfile_readv_cbk, subvol,
+		    subvol->fops->readv, fd, size, offset, 0, NULL);
+}
+
+
+static void
+glfs_sendfile_wait (struct glfs_sendfile_chunk *chunk)
+{
+	pthread_mutex_lock (&chunk->mutex);
+	{
+		while (chunk->busy)
+			pthread_cond_wait (&chunk->cond, &chunk->mutex);
+	}
+	pthread_mutex_unlock (&chunk->mutex);
+}
+
+
+static void
+glfs_sendfile_release (struct glfs_sendfile_chunk *chunk)
+{
+	GF_FREE (chunk->iov);
+	if (chunk->iobref)
+		iobref_unref (chunk->iobref);
+
+	chunk->iov = NULL;
+	chunk->count = 0;
+	chunk->iobref = NULL;
+}
+
+
+/* Writes all of @iov to @out_fd, consuming @iov as it goes. Returns the
+   number of bytes written, which is short only if @errno is set. */
+static ssize_t
+glfs_sendfile_push (int out_fd, struct iovec *iov, int count)
+{
+	ssize_t written = 0;
+	ssize_t ret = 0;
+
+	while (count) {
+		ret = writev (out_fd, iov, min (count, IOV_MAX));
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		written += ret;
+
+		while (count && ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if (count) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return written;
+}
+
+
+ssize_t
+glfs_sendfile (struct glfs_fd *glfd, int out_fd, off_t offset, size_t count)
+{
+	xlator_t                   *subvol = NULL;
+	fd_t                       *fd = NULL;
+	struct glfs_sendfile_chunk  chunks[2];
+	struct glfs_sendfile_chunk *cur = NULL;
+	struct glfs_sendfile_chunk *next = NULL;
+	struct glfs_sendfile_chunk *tmp = NULL;
+	size_t                      pos = 0;
+	size_t                      size = 0;
+	ssize_t                     written = 0;
+	ssize_t                     ret = -1;
+	int                         op_errno = 0;
+	int                         i = 0;
+
+	__glfs_entry_fd (glfd);
+
+	subvol = glfs_active_subvol (glfd->fs);
+	if (!subvol) {
+		errno = EIO;
+		goto out;
+	}
+
+	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
+	if (!fd) {
+		errno = EBADFD;
+		goto out;
+	}
+
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
+	if (!count)
+		goto out;
+
+	memset (chunks, 0, sizeof (chunks));
+	for (i = 0; i < 2; i++) {
+		pthread_mutex_init (&chunks[i].mutex, NULL);
+		pthread_cond_init (&chunks[i].cond, NULL);
+	}
+
+	cur = &chunks[0];
+	next = &chunks[1];
+
+	glfs_sendfile_wind (cur, subvol, fd,
+			    min (count, GLFS_SENDFILE_CHUNK_SIZE), offset);
+
+	for (;;) {
+		size = min (count - pos, GLFS_SENDFILE_CHUNK_SIZE);
+
+		glfs_sendfile_wait (cur);
+		if (cur->ret <= 0) {
+			op_errno = cur->op_errno;
+			break;
+		}
+
+		/* read the next chunk while this one goes out */
+		if (cur->ret == size && pos + size < count)
+			glfs_sendfile_wind (next, subvol, fd,
+					    min (count - pos - size,
+						 GLFS_SENDFILE_CHUNK_SIZE),
+					    offset + pos + size);
+
+		written = glfs_sendfile_push (out_fd, cur->iov, cur->count);
+		glfs_sendfile_release (cur);
+
+		pos += written;
+		if (written < cur->ret) {
+			op_errno = errno;
+			break;
+		}
+
+		if (pos >= count || cur->ret < size)
+			break;
+
+		tmp = cur;
+		cur = next;
+		next = tmp;
+	}
+
+	for (i = 0; i < 2; i++) {
+		glfs_sendfile_wait (&chunks[i]);
+		glfs_sendfile_release (&chunks[i]);
+		pthread_mutex_destroy (&chunks[i].mutex);
+		pthread_cond_destroy (&chunks[i].cond);
+	}
+
+	ret = pos;
+	if (!pos && op_errno) {
+		errno = op_errno;
+		ret = -1;
+	}
+out:
+	if (fd)
+		fd_unref (fd);
+
+	glfs_subvol_done (glfd->fs, subvol);
+
+	return ret;
+}
+
+
+ssize_t
+glfs_write (struct glfs_fd *glfd, const void *buf, size_t count, int flags)
+{
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = count;
+
+	ret = glfs_pwritev (glfd, &iov, 1, glfd->offset, flags);
+
+	return ret;
+}
+
+
+
+ssize_t
+glfs_writev (struct glfs_fd *glfd, const struct iovec *iov, int count,
+	     int flags)
+{
+	ssize_t      ret = 0;
+
+	ret = glfs_pwritev (glfd, iov, count, glfd->offset, flags);
+
+	return ret;
+}
+
+
+ssize_t
+glfs_pwrite (struct glfs_fd *glfd, const void *buf, size_t count, off_t offset,
+	     int flags)
+{
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = count;
+
+	ret = glfs_pwritev (glfd, &iov, 1, offset, flags);
+
+	return ret;
+}
+
+
+static void
+glfs_pwritev_async_wind (struct glfs_io *gio)
+{
+	STACK_WIND (gio->frame, glfs_io_async_cbk, gio->subvol,
+		    gio->subvol->fops->writev, gio->fd, &gio->wvec, 1,
+		    gio->offset, gio->flags, gio->iobref, NULL);
+}
+
+
+int
+glfs_pwritev_async (struct glfs_fd *glfd, const struct iovec *iovec, int count,
+		    off_t offset, int flags, glfs_io_cbk fn, void *data)
+{
+	struct glfs_io *gio = NULL;
+	struct iobref  *iobref = NULL;
+	struct iobuf   *iobuf = NULL;
+	size_t          size = 0;
+
+	__glfs_entry_fd (glfd);
+
+	gio = glfs_io_new (glfd, GF_FOP_WRITE, fn, data);
+	if (!gio)
+		return -1;
+
+	size = iov_length (iovec, count);
+
+	iobuf = iobuf_get2 (glfd->fs->ctx->iobuf_pool, size);
+	if (!iobuf)
+		goto enomem;
+
+	iobref = iobref_new ();
+	if (!iobref)
+		goto enomem;
+
+	if (iobref_add (iobref, iobuf))
+		goto enomem;
+
+	iov_unload (iobuf_ptr (iobuf), iovec, count);
+
+	gio->wvec.iov_base = iobuf_ptr (iobuf);
+	gio->wvec.iov_len = size;
+	gio->offset = offset;
+	gio->flags = flags;
+	gio->iobref = iobref;
+
+	iobuf_unref (iobuf);
+
+	glfs_io_wind (gio, glfs_pwritev_async_wind);
+
+	return 0;
+enomem:
+	if (iobuf)
+		iobuf_unref (iobuf);
+	if (iobref)
+		iobref_unref (iobref);
+
+	glfs_io_destroy (gio);
+	errno = ENOMEM;
+	return -1;
+}
+
+
+int
+glfs_write_async (struct glfs_fd *glfd, const void *buf, size_t count, int flags,
+		  glfs_io_cbk fn, void *data)
+{
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = count;
+
+	ret = glfs_pwritev_async (glfd, &iov, 1, glfd->offset, flags, fn, data);
+
+	return ret;
+}
+
+
+int
+glfs_pwrite_async (struct glfs_fd *glfd, const void *buf, int count,
+		   off_t offset, int flags, glfs_io_cbk fn, void *data)
+{
+	struct iovec iov = {0, };
+	ssize_t      ret = 0;
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = count;
+
+	ret = glfs_pwritev_async (glfd, &iov, 1, offset, flags, fn, data);
+
+	return ret;
+}
+
+
+int
+glfs_writev_async (struct glfs_fd *glfd, const struct iovec *iov, int count,
+		   int flags, glfs_io_cbk fn, void *data)
+{
+	ssize_t      ret = 0;
+
+	ret = glfs_pwritev_async (glfd, iov, count, glfd->offset, flags,
+				  fn, data);
+	return ret;
+}
+
+
+int
+glfs_fsync (struct glfs_fd *glfd)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	fd_t            *fd = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	subvol = glfs_active_subvol (glfd->fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+
+	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
+	if (!fd) {
+		ret = -1;
+		errno = EBADFD;
+		goto out;
+	}
+
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
+	ret = syncop_fsync (subvol, fd, 0);
+out:
+	if (fd)
+		fd_unref (fd);
+
+	glfs_subvol_done (glfd->fs, subvol);
+
+	return ret;
+}
+
+
+static void
+glfs_fsync_async_wind (struct glfs_io *gio)
+{
+	STACK_WIND (gio->frame, glfs_io_async_cbk, gio->subvol,
+		    gio->subvol->fops->fsync, gio->fd, gio->flags, NULL);
+}
+
+
+static int
+glfs_fsync_async_common (struct glfs_fd *glfd, glfs_io_cbk fn, void *data,
+			 int dataonly)
+{
+	struct glfs_io *gio = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	gio = glfs_io_new (glfd, GF_FOP_FSYNC, fn, data);
+	if (!gio)
+		return -1;
+
+	gio->flags = dataonly;
+
+	glfs_io_wind (gio, glfs_fsync_async_wind);
+
+	return 0;
+}
+
+
+int
+glfs_fsync_async (struct glfs_fd *glfd, glfs_io_cbk fn, void *data)
+{
+	return glfs_fsync_async_common (glfd, fn, data, 0);
+}
+
+
+int
+glfs_fdatasync (struct glfs_fd *glfd)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	fd_t            *fd = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	subvol = glfs_active_subvol (glfd->fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+
+	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
+	if (!fd) {
+		ret = -1;
+		errno = EBADFD;
+		goto out;
+	}
+
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
+	ret = syncop_fsync (subvol, fd, 1);
+out:
+	if (fd)
+		fd_unref (fd);
+
+	glfs_subvol_done (glfd->fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_fdatasync_async (struct glfs_fd *glfd, glfs_io_cbk fn, void *data)
+{
+	return glfs_fsync_async_common (glfd, fn, data, 1);
+}
+
+
+int
+glfs_ftruncate (struct glfs_fd *glfd, off_t offset)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	fd_t            *fd = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	subvol = glfs_active_subvol (glfd->fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+
+	fd = glfs_resolve_fd (glfd->fs, subvol, glfd);
+	if (!fd) {
+		ret = -1;
+		errno = EBADFD;
+		goto out;
+	}
+
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
+	ret = syncop_ftruncate (subvol, fd, offset);
+	glfs_iatt_cache_invalidate (glfd->fs, fd->inode);
+	glfs_ra_invalidate (glfd);
+out:
+	if (fd)
+		fd_unref (fd);
+
+	glfs_subvol_done (glfd->fs, subvol);
+
+	return ret;
+}
+
+
+static void
+glfs_ftruncate_async_wind (struct glfs_io *gio)
+{
+	STACK_WIND (gio->frame, glfs_io_async_cbk, gio->subvol,
+		    gio->subvol->fops->ftruncate, gio->fd, gio->offset,
+		    NULL);
+}
+
+
+int
+glfs_ftruncate_async (struct glfs_fd *glfd, off_t offset,
+		      glfs_io_cbk fn, void *data)
+{
+	struct glfs_io *gio = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	gio = glfs_io_new (glfd, GF_FOP_FTRUNCATE, fn, data);
+	if (!gio)
+		return -1;
+
+	gio->offset = offset;
+
+	glfs_io_wind (gio, glfs_ftruncate_async_wind);
+
+	return 0;
+}
+
+
+int
+glfs_access (struct glfs *fs, const char *path, int mode)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            loc = {0, };
+	struct iatt      iatt = {0, };
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+retry:
+	ret = glfs_resolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret)
+		goto out;
+
+	ret = syncop_access (subvol, &loc, mode);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+out:
+	loc_wipe (&loc);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_symlink (struct glfs *fs, const char *data, const char *path)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            loc = {0, };
+	struct iatt      iatt = {0, };
+	uuid_t           gfid;
+	dict_t          *xattr_req = NULL;
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+
+	xattr_req = dict_new ();
+	if (!xattr_req) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+
+	uuid_generate (gfid);
+	ret = dict_set_static_bin (xattr_req, "gfid-req", gfid, 16);
+	if (ret) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+retry:
+	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (loc.inode) {
+		errno = EEXIST;
+		ret = -1;
+		goto out;
+	}
+
+	if (ret == -1 && errno != ENOENT)
+		/* Any other type of error is fatal */
+		goto out;
+
+	if (ret == -1 && errno == ENOENT && !loc.parent)
+		/* The parent directory or an ancestor even
+		   higher does not exist
+		*/
+		goto out;
+
+	/* ret == -1 && errno == ENOENT */
+	loc.inode = inode_new (loc.parent->table);
+	if (!loc.inode) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+
+	ret = syncop_symlink (subvol, &loc, data, xattr_req, &iatt);
+
+	glfs_loc_invalidate (fs, &loc);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret == 0)
+		ret = glfs_loc_link (fs, &loc, &iatt);
+out:
+	loc_wipe (&loc);
+
+	if (xattr_req)
+		dict_unref (xattr_req);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_readlink (struct glfs *fs, const char *path, char *buf, size_t bufsiz)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            loc = {0, };
+	struct iatt      iatt = {0, };
+	int              reval = 0;
+	char            *linkval = NULL;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+retry:
+	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret)
+		goto out;
+
+	if (iatt.ia_type != IA_IFLNK) {
+		ret = -1;
+		errno = EINVAL;
+		goto out;
+	}
+
+	ret = syncop_readlink (subvol, &loc, &linkval, bufsiz);
+	if (ret > 0) {
+		memcpy (buf, linkval, ret);
+		GF_FREE (linkval);
+	}
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+out:
+	loc_wipe (&loc);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_mknod (struct glfs *fs, const char *path, mode_t mode, dev_t dev)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            loc = {0, };
+	struct iatt      iatt = {0, };
+	uuid_t           gfid;
+	dict_t          *xattr_req = NULL;
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+
+	xattr_req = dict_new ();
+	if (!xattr_req) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+
+	uuid_generate (gfid);
+	ret = dict_set_static_bin (xattr_req, "gfid-req", gfid, 16);
+	if (ret) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+retry:
+	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (loc.inode) {
+		errno = EEXIST;
+		ret = -1;
+		goto out;
+	}
+
+	if (ret == -1 && errno != ENOENT)
+		/* Any other type of error is fatal */
+		goto out;
+
+	if (ret == -1 && errno == ENOENT && !loc.parent)
+		/* The parent directory or an ancestor even
+		   higher does not exist
+		*/
+		goto out;
+
+	/* ret == -1 && errno == ENOENT */
+	loc.inode = inode_new (loc.parent->table);
+	if (!loc.inode) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+
+	ret = syncop_mknod (subvol, &loc, mode, dev, xattr_req, &iatt);
+
+	glfs_loc_invalidate (fs, &loc);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret == 0)
+		ret = glfs_loc_link (fs, &loc, &iatt);
+out:
+	loc_wipe (&loc);
+
+	if (xattr_req)
+		dict_unref (xattr_req);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_mkdir (struct glfs *fs, const char *path, mode_t mode)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            loc = {0, };
+	struct iatt      iatt = {0, };
+	uuid_t           gfid;
+	dict_t          *xattr_req = NULL;
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+
+	xattr_req = dict_new ();
+	if (!xattr_req) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+
+	uuid_generate (gfid);
+	ret = dict_set_static_bin (xattr_req, "gfid-req", gfid, 16);
 	if (ret) {
 		ret = -1;
-		errno = ENOMEM;
+		errno = ENOMEM;
+		goto out;
+	}
+retry:
+	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (loc.inode) {
+		errno = EEXIST;
+		ret = -1;
+		goto out;
+	}
+
+	if (ret == -1 && errno != ENOENT)
+		/* Any other type of error is fatal */
+		goto out;
+
+	if (ret == -1 && errno == ENOENT && !loc.parent)
+		/* The parent directory or an ancestor even
+		   higher does not exist
+		*/
+		goto out;
+
+	/* ret == -1 && errno == ENOENT */
+	loc.inode = inode_new (loc.parent->table);
+	if (!loc.inode) {
+		ret = -1;
+		errno = ENOMEM;
+		goto out;
+	}
+
+	ret = syncop_mkdir (subvol, &loc, mode, xattr_req, &iatt);
+
+	glfs_loc_invalidate (fs, &loc);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret == 0)
+		ret = glfs_loc_link (fs, &loc, &iatt);
+out:
+	loc_wipe (&loc);
+
+	if (xattr_req)
+		dict_unref (xattr_req);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_unlink (struct glfs *fs, const char *path)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            loc = {0, };
+	struct iatt      iatt = {0, };
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+retry:
+	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret)
+		goto out;
+
+	if (iatt.ia_type == IA_IFDIR) {
+		ret = -1;
+		errno = EISDIR;
+		goto out;
+	}
+
+	ret = syncop_unlink (subvol, &loc);
+
+	glfs_loc_invalidate (fs, &loc);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret == 0)
+		ret = glfs_loc_unlink (&loc);
+out:
+	loc_wipe (&loc);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_rmdir (struct glfs *fs, const char *path)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            loc = {0, };
+	struct iatt      iatt = {0, };
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+retry:
+	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret)
+		goto out;
+
+	if (iatt.ia_type != IA_IFDIR) {
+		ret = -1;
+		errno = ENOTDIR;
+		goto out;
+	}
+
+	ret = syncop_rmdir (subvol, &loc);
+
+	glfs_loc_invalidate (fs, &loc);
+	if (ret == 0)
+		glfs_dircache_flush (fs);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret == 0)
+		ret = glfs_loc_unlink (&loc);
+out:
+	loc_wipe (&loc);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_rename (struct glfs *fs, const char *oldpath, const char *newpath)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            oldloc = {0, };
+	loc_t            newloc = {0, };
+	struct iatt      oldiatt = {0, };
+	struct iatt      newiatt = {0, };
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
+		goto out;
+	}
+retry:
+	ret = glfs_lresolve (fs, subvol, oldpath, &oldloc, &oldiatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &oldloc, retry);
+
+	if (ret)
+		goto out;
+retrynew:
+	ret = glfs_lresolve (fs, subvol, newpath, &newloc, &newiatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &newloc, retrynew);
+
+	if (ret && errno != ENOENT && newloc.parent)
+		goto out;
+
+	if (newiatt.ia_type != IA_INVAL) {
+                if ((oldiatt.ia_type == IA_IFDIR) !=
+                    (newiatt.ia_type == IA_IFDIR)) {
+                       /* Either both old and new must be dirs,
+                        * or both must be non-dirs. Else, fail.
+                        */
+                       ret = -1;
+                       errno = EISDIR;
+                       goto out;
+                }
+        }
+
+	/* TODO: check if new or old is a prefix of the other, and fail EINVAL */
+
+	ret = syncop_rename (subvol, &oldloc, &newloc);
+
+	glfs_loc_invalidate (fs, &oldloc);
+	glfs_loc_invalidate (fs, &newloc);
+	if (ret == 0 && IA_ISDIR (oldiatt.ia_type))
+		glfs_dircache_flush (fs);
+
+	if (ret == -1 && errno == ESTALE) {
+		if (reval < DEFAULT_REVAL_COUNT) {
+			reval++;
+			loc_wipe (&oldloc);
+			loc_wipe (&newloc);
+			goto retry;
+		}
+	}
+
+	if (ret == 0)
+		inode_rename (oldloc.parent->table, oldloc.parent, oldloc.name,
+			      newloc.parent, newloc.name, oldloc.inode,
+			      &oldiatt);
+out:
+	loc_wipe (&oldloc);
+	loc_wipe (&newloc);
+
+	glfs_subvol_done (fs, subvol);
+
+	return ret;
+}
+
+
+int
+glfs_link (struct glfs *fs, const char *oldpath, const char *newpath)
+{
+	int              ret = -1;
+	xlator_t        *subvol = NULL;
+	loc_t            oldloc = {0, };
+	loc_t            newloc = {0, };
+	struct iatt      oldiatt = {0, };
+	struct iatt      newiatt = {0, };
+	int              reval = 0;
+
+	__glfs_entry_fs (fs);
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol) {
+		ret = -1;
+		errno = EIO;
 		goto out;
 	}
 retry:
-	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+	ret = glfs_lresolve (fs, subvol, oldpath, &oldloc, &oldiatt, reval);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	ESTALE_RETRY (ret, errno, reval, &oldloc, retry);
 
-	if (loc.inode) {
-		errno = EEXIST;
-		ret = -1;
+	if (ret)
 		goto out;
-	}
+retrynew:
+	ret = glfs_lresolve (fs, subvol, newpath, &newloc, &newiatt, reval);
 
-	if (ret == -1 && errno != ENOENT)
-		/* Any other type of error is fatal */
-		goto out;
+	ESTALE_RETRY (ret, errno, reval, &newloc, retrynew);
 
-	if (ret == -1 && errno == ENOENT && !loc.parent)
-		/* The parent directory or an ancestor even
-		   higher does not exist
-		*/
+	if (ret == 0) {
+		ret = -1;
+		errno = EEXIST;
 		goto out;
+	}
 
-	/* ret == -1 && errno == ENOENT */
-	loc.inode = inode_new (loc.parent->table);
-	if (!loc.inode) {
+	if (oldiatt.ia_type == IA_IFDIR) {
 		ret = -1;
-		errno = ENOMEM;
+		errno = EISDIR;
 		goto out;
 	}
 
-	ret = syncop_mknod (subvol, &loc, mode, dev, xattr_req, &iatt);
+        /* Filling the inode of the hard link to be same as that of the
+           original file
+        */
+	if (newloc.inode) {
+		inode_unref (newloc.inode);
+		newloc.inode = NULL;
+	}
+        newloc.inode = inode_ref (oldloc.inode);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	ret = syncop_link (subvol, &oldloc, &newloc);
+
+	glfs_loc_invalidate (fs, &oldloc);
+	glfs_loc_invalidate (fs, &newloc);
+
+	if (ret == -1 && errno == ESTALE) {
+		loc_wipe (&oldloc);
+		loc_wipe (&newloc);
+		if (reval--)
+			goto retry;
+	}
 
 	if (ret == 0)
-		ret = glfs_loc_link (&loc, &iatt);
+		ret = glfs_loc_link (fs, &newloc, &oldiatt);
 out:
-	loc_wipe (&loc);
-
-	if (xattr_req)
-		dict_unref (xattr_req);
+	loc_wipe (&oldloc);
+	loc_wipe (&newloc);
 
 	glfs_subvol_done (fs, subvol);
 
@@ -1323,15 +3666,14 @@ out:
 }
 
 
-int
-glfs_mkdir (struct glfs *fs, const char *path, mode_t mode)
+struct glfs_fd *
+glfs_opendir (struct glfs *fs, const char *path)
 {
 	int              ret = -1;
+	struct glfs_fd  *glfd = NULL;
 	xlator_t        *subvol = NULL;
 	loc_t            loc = {0, };
 	struct iatt      iatt = {0, };
-	uuid_t           gfid;
-	dict_t          *xattr_req = NULL;
 	int              reval = 0;
 
 	__glfs_entry_fs (fs);
@@ -1343,476 +3685,959 @@ glfs_mkdir (struct glfs *fs, const char *path, mode_t mode)
 		goto out;
 	}
 
-	xattr_req = dict_new ();
-	if (!xattr_req) {
+	glfd = glfs_fd_new (fs);
+	if (!glfd)
+		goto out;
+
+	INIT_LIST_HEAD (&glfd->entries);
+	INIT_LIST_HEAD (&glfd->prev_entries);
+retry:
+	ret = glfs_resolve (fs, subvol, path, &loc, &iatt, reval);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+
+	if (ret)
+		goto out;
+
+	if (!IA_ISDIR (iatt.ia_type)) {
 		ret = -1;
-		errno = ENOMEM;
+		errno = ENOTDIR;
 		goto out;
 	}
 
-	uuid_generate (gfid);
-	ret = dict_set_static_bin (xattr_req, "gfid-req", gfid, 16);
-	if (ret) {
+	if (glfd->fd) {
+		/* Retry. Safe to touch glfd->fd as we
+		   still have not glfs_fd_bind() yet.
+		*/
+		fd_unref (glfd->fd);
+		glfd->fd = NULL;
+	}
+
+	glfd->fd = fd_create (loc.inode, getpid());
+	if (!glfd->fd) {
 		ret = -1;
 		errno = ENOMEM;
 		goto out;
 	}
-retry:
-	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	ret = syncop_opendir (subvol, &loc, glfd->fd);
+
+	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+out:
+	loc_wipe (&loc);
+
+	if (ret && glfd) {
+		glfs_fd_destroy (glfd);
+		glfd = NULL;
+	} else {
+		fd_bind (glfd->fd);
+		glfs_fd_bind (glfd);
+	}
+
+	glfs_subvol_done (fs, subvol);
+
+	return glfd;
+}
+
+
+int
+glfs_closedir (struct glfs_fd *glfd)
+{
+	__glfs_entry_fd (glfd);
+
+	gf_dirent_free (list_entry (&glfd->entries, gf_dirent_t, list));
+	gf_dirent_free (list_entry (&glfd->prev_entries, gf_dirent_t, list));
+
+	GF_FREE (glfd->index.slots);
+	GF_FREE (glfd->prev_index.slots);
+
+	glfs_fd_destroy (glfd);
+
+	return 0;
+}
+
+
+static inline unsigned int
+glfs_dirindex_hash (struct glfs_dirindex *index, off_t d_off)
+{
+	return ((uint64_t) d_off * 0x9e3779b97f4a7c15ULL) >> (64 - index->bits);
+}
+
+
+/* Indexes the batch @entries by d_off, for glfs_seekdir() */
+static void
+glfs_dirindex_build (struct glfs_dirindex *index, struct list_head *entries)
+{
+	gf_dirent_t  *entry = NULL;
+	unsigned int  mask = 0;
+	unsigned int  slot = 0;
+	int           count = 0;
+	int           bits = 4;
+
+	list_for_each_entry (entry, entries, list)
+		count++;
+
+	/* keep the table at most half full */
+	while ((1 << bits) < 2 * count)
+		bits++;
+
+	if (bits != index->bits || !index->slots) {
+		GF_FREE (index->slots);
+		index->bits = 0;
+		index->slots = GF_CALLOC (1 << bits, sizeof (gf_dirent_t *),
+					  glfs_mt_glfs_dirindex_t);
+		if (!index->slots)
+			return;
+		index->bits = bits;
+	} else {
+		memset (index->slots, 0, (1 << bits) * sizeof (gf_dirent_t *));
+	}
+
+	mask = (1 << bits) - 1;
+
+	list_for_each_entry (entry, entries, list) {
+		slot = glfs_dirindex_hash (index, entry->d_off);
+		while (index->slots[slot])
+			slot = (slot + 1) & mask;
+		index->slots[slot] = entry;
+	}
+}
+
+
+static gf_dirent_t *
+glfs_dirindex_get (struct glfs_dirindex *index, off_t d_off)
+{
+	unsigned int  mask = 0;
+	unsigned int  slot = 0;
+
+	if (!index->slots)
+		return NULL;
+
+	mask = (1 << index->bits) - 1;
+
+	for (slot = glfs_dirindex_hash (index, d_off); index->slots[slot];
+	     slot = (slot + 1) & mask) {
+		if (index->slots[slot]->d_off == d_off)
+			return index->slots[slot];
+	}
+
+	return NULL;
+}
+
+
+/* Exchanges the current and the previous batch of entries */
+static void
+glfd_batch_swap (struct glfs_fd *glfd)
+{
+	struct list_head      tmp;
+	struct glfs_dirindex  index;
+
+	INIT_LIST_HEAD (&tmp);
+	list_splice_init (&glfd->entries, &tmp);
+	list_splice_init (&glfd->prev_entries, &glfd->entries);
+	list_splice_init (&tmp, &glfd->prev_entries);
+
+	index = glfd->index;
+	glfd->index = glfd->prev_index;
+	glfd->prev_index = index;
+}
+
+
+long
+glfs_telldir (struct glfs_fd *fd)
+{
+	return fd->offset;
+}
+
+
+void
+glfs_seekdir (struct glfs_fd *fd, long offset)
+{
+	gf_dirent_t          *entry = NULL;
+
+	if (fd->offset == offset)
+		return;
+
+	fd->offset = offset;
+	fd->next = NULL;
+
+	entry = glfs_dirindex_get (&fd->index, offset);
+	if (entry) {
+		if (&entry->next->list != &fd->entries)
+			/* found! */
+			fd->next = entry->next;
+		return;
+	}
+
+	/* the previous batch is kept around for telldir()/seekdir()
+	   going back and forth across a batch boundary */
+	entry = glfs_dirindex_get (&fd->prev_index, offset);
+	if (!entry)
+		/* could not find entry at requested offset in the cache.
+		   next readdir_r() will result in glfd_entry_refresh()
+		*/
+		return;
+
+	if (&entry->next->list == &fd->prev_entries) {
+		/* continues with the current batch, unless the previous
+		   batch is the one following it */
+		if (!fd->prev_follows && !list_empty (&fd->entries))
+			fd->next = list_entry (fd->entries.next, gf_dirent_t,
+					       list);
+		return;
+	}
+
+	fd->next = entry->next;
+
+	/* make the previous batch current again, the one it is swapped
+	   with is picked up where it ends */
+	glfd_batch_swap (fd);
+	fd->prev_follows = !fd->prev_follows;
+}
+
+static void
+glfs_discard_async_wind (struct glfs_io *gio)
+{
+	STACK_WIND (gio->frame, glfs_io_async_cbk, gio->subvol,
+		    gio->subvol->fops->discard, gio->fd, gio->offset,
+		    gio->size, NULL);
+}
+
+
+int
+glfs_discard_async (struct glfs_fd *glfd, off_t offset, size_t len,
+		      glfs_io_cbk fn, void *data)
+{
+	struct glfs_io *gio = NULL;
+
+	__glfs_entry_fd (glfd);
+
+	gio = glfs_io_new (glfd, GF_FOP_DISCARD, fn, data);
+	if (!gio)
+		return -1;
+
+	gio->offset = offset;
+	gio->size = len;
+
+	glfs_io_wind (gio, glfs_discard_async_wind);
+
+	return 0;
+}
+
+
+///// batched IO queue /////
+
+#define GLFS_IOQ_INLINE_IOV 8
+
+struct glfs_ioq_slot {
+	struct list_head     list;
+	struct glfs_ioq     *ioq;
+	struct glfs_fd      *glfd;
+	xlator_t            *subvol;
+	fd_t                *fd;
+	int                  op;
+	off_t                offset;
+	struct iovec        *iov;
+	int                  count;
+	struct iovec         iov_inline[GLFS_IOQ_INLINE_IOV];
+	void                *data;
+};
+
+
+/* Slots and completion events are allocated once, at glfs_ioq_create(),
+   so that submission and completion do not allocate per request.
+*/
+struct glfs_ioq {
+	struct glfs           *fs;
+	pthread_mutex_t        mutex;
+	pthread_cond_t         cond;
+	int                    depth;
+	int                    inflight;
+	struct list_head       free;
+	struct glfs_ioq_slot  *slots;
+	struct glfs_ioevent   *events;
+	int                    head;     /* next event to be reaped */
+	int                    nevents;  /* completed, not reaped yet */
+};
+
+
+struct glfs_ioq *
+glfs_ioq_create (struct glfs *fs, int depth)
+{
+	struct glfs_ioq *ioq = NULL;
+	int              i = 0;
+
+	__glfs_entry_fs (fs);
+
+	if (depth <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ioq = GF_CALLOC (1, sizeof (*ioq), glfs_mt_glfs_ioq_t);
+	if (!ioq)
+		goto enomem;
+
+	ioq->slots = GF_CALLOC (depth, sizeof (*ioq->slots),
+				glfs_mt_glfs_ioq_t);
+	if (!ioq->slots)
+		goto enomem;
+
+	ioq->events = GF_CALLOC (depth, sizeof (*ioq->events),
+				 glfs_mt_glfs_ioq_t);
+	if (!ioq->events)
+		goto enomem;
+
+	ioq->fs = fs;
+	ioq->depth = depth;
+
+	pthread_mutex_init (&ioq->mutex, NULL);
+	pthread_cond_init (&ioq->cond, NULL);
 
-	if (loc.inode) {
-		errno = EEXIST;
-		ret = -1;
-		goto out;
+	INIT_LIST_HEAD (&ioq->free);
+	for (i = 0; i < depth; i++) {
+		ioq->slots[i].ioq = ioq;
+		list_add_tail (&ioq->slots[i].list, &ioq->free);
 	}
 
-	if (ret == -1 && errno != ENOENT)
-		/* Any other type of error is fatal */
-		goto out;
+	return ioq;
+enomem:
+	if (ioq) {
+		GF_FREE (ioq->slots);
+		GF_FREE (ioq->events);
+		GF_FREE (ioq);
+	}
+	errno = ENOMEM;
+	return NULL;
+}
 
-	if (ret == -1 && errno == ENOENT && !loc.parent)
-		/* The parent directory or an ancestor even
-		   higher does not exist
-		*/
-		goto out;
 
-	/* ret == -1 && errno == ENOENT */
-	loc.inode = inode_new (loc.parent->table);
-	if (!loc.inode) {
-		ret = -1;
-		errno = ENOMEM;
-		goto out;
-	}
+static struct glfs_ioq_slot *
+glfs_ioq_slot_get (struct glfs_ioq *ioq)
+{
+	struct glfs_ioq_slot *slot = NULL;
 
-	ret = syncop_mkdir (subvol, &loc, mode, xattr_req, &iatt);
+	pthread_mutex_lock (&ioq->mutex);
+	{
+		/* keep room in @events for everything in flight */
+		if (ioq->inflight + ioq->nevents >= ioq->depth)
+			goto unlock;
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+		if (list_empty (&ioq->free))
+			goto unlock;
 
-	if (ret == 0)
-		ret = glfs_loc_link (&loc, &iatt);
-out:
-	loc_wipe (&loc);
+		slot = list_entry (ioq->free.next, struct glfs_ioq_slot, list);
+		list_del_init (&slot->list);
+		ioq->inflight++;
+	}
+unlock:
+	pthread_mutex_unlock (&ioq->mutex);
 
-	if (xattr_req)
-		dict_unref (xattr_req);
+	return slot;
+}
 
-	glfs_subvol_done (fs, subvol);
 
-	return ret;
+static void
+glfs_ioq_complete (struct glfs_ioq_slot *slot, ssize_t ret, int op_errno)
+{
+	struct glfs_ioq      *ioq = NULL;
+	struct glfs_ioevent  *event = NULL;
+	struct glfs_fd       *glfd = NULL;
+	xlator_t             *subvol = NULL;
+	void                 *data = NULL;
+
+	ioq = slot->ioq;
+	glfd = slot->glfd;
+	subvol = slot->subvol;
+	data = slot->data;
+
+	if (slot->fd)
+		fd_unref (slot->fd);
+	if (slot->iov != slot->iov_inline)
+		GF_FREE (slot->iov);
+
+	slot->fd = NULL;
+	slot->iov = NULL;
+	slot->subvol = NULL;
+
+	pthread_mutex_lock (&ioq->mutex);
+	{
+		event = &ioq->events[(ioq->head + ioq->nevents) % ioq->depth];
+		event->fd = glfd;
+		event->ret = ret;
+		event->err = (ret < 0) ? op_errno : 0;
+		event->data = data;
+
+		ioq->nevents++;
+		ioq->inflight--;
+		list_add (&slot->list, &ioq->free);
+
+		pthread_cond_broadcast (&ioq->cond);
+	}
+	pthread_mutex_unlock (&ioq->mutex);
+
+	if (subvol)
+		glfs_subvol_done (ioq->fs, subvol);
 }
 
 
-int
-glfs_unlink (struct glfs *fs, const char *path)
+static int
+glfs_ioq_readv_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		    int32_t op_ret, int32_t op_errno, struct iovec *vector,
+		    int32_t count, struct iatt *stbuf, struct iobref *iobref,
+		    dict_t *xdata)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            loc = {0, };
-	struct iatt      iatt = {0, };
-	int              reval = 0;
+	struct glfs_ioq_slot *slot = NULL;
+	struct glfs          *fs = NULL;
+	ssize_t               ret = op_ret;
 
-	__glfs_entry_fs (fs);
+	slot = frame->local;
+	frame->local = NULL;
+	fs = slot->ioq->fs;
 
-	subvol = glfs_active_subvol (fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
+	if (op_ret > 0) {
+		ret = iov_copy (slot->iov, slot->count, vector, count);
+		slot->glfd->offset = (slot->offset + ret);
 	}
-retry:
-	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	glfs_ioq_complete (slot, ret, op_errno);
 
-	if (ret)
-		goto out;
+	glfs_bg_frame_destroy (fs, frame);
 
-	if (iatt.ia_type == IA_IFDIR) {
-		ret = -1;
-		errno = EISDIR;
-		goto out;
-	}
+	return 0;
+}
 
-	ret = syncop_unlink (subvol, &loc);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+static int
+glfs_ioq_writev_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		     int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+		     struct iatt *postbuf, dict_t *xdata)
+{
+	struct glfs_ioq_slot *slot = NULL;
+	struct glfs          *fs = NULL;
 
-	if (ret == 0)
-		ret = glfs_loc_unlink (&loc);
-out:
-	loc_wipe (&loc);
+	slot = frame->local;
+	frame->local = NULL;
+	fs = slot->ioq->fs;
 
-	glfs_subvol_done (fs, subvol);
+	if (op_ret > 0)
+		slot->glfd->offset = (slot->offset + op_ret);
 
-	return ret;
+	glfs_iatt_cache_invalidate (slot->glfd->fs, slot->fd->inode);
+	glfs_ra_invalidate (slot->glfd);
+
+	glfs_ioq_complete (slot, op_ret, op_errno);
+
+	glfs_bg_frame_destroy (fs, frame);
+
+	return 0;
 }
 
 
-int
-glfs_rmdir (struct glfs *fs, const char *path)
+static int
+glfs_ioq_fsync_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+		    int32_t op_ret, int32_t op_errno, struct iatt *prebuf,
+		    struct iatt *postbuf, dict_t *xdata)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            loc = {0, };
-	struct iatt      iatt = {0, };
-	int              reval = 0;
+	struct glfs_ioq_slot *slot = NULL;
+	struct glfs          *fs = NULL;
 
-	__glfs_entry_fs (fs);
+	slot = frame->local;
+	frame->local = NULL;
+	fs = slot->ioq->fs;
 
-	subvol = glfs_active_subvol (fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
-retry:
-	ret = glfs_lresolve (fs, subvol, path, &loc, &iatt, reval);
+	glfs_ioq_complete (slot, op_ret, op_errno);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+	glfs_bg_frame_destroy (fs, frame);
 
-	if (ret)
-		goto out;
+	return 0;
+}
 
-	if (iatt.ia_type != IA_IFDIR) {
-		ret = -1;
-		errno = ENOTDIR;
-		goto out;
-	}
 
-	ret = syncop_rmdir (subvol, &loc);
+/* Wind @req on @slot. Completion, including failure to wind, is always
+   reported through glfs_ioq_complete(). @slot must not be touched after
+   the STACK_WIND as the reply may already have been processed.
+*/
+static void
+glfs_ioq_wind (struct glfs_ioq_slot *slot, struct glfs_ioreq *req)
+{
+	call_frame_t   *frame = NULL;
+	xlator_t       *subvol = NULL;
+	fd_t           *fd = NULL;
+	struct iobuf   *iobuf = NULL;
+	struct iobref  *iobref = NULL;
+	struct iovec    iov = {0, };
+	size_t          size = 0;
+
+	subvol = slot->subvol;
+	fd = slot->fd;
+	size = iov_length (req->iov, req->iovcnt);
+
+	frame = glfs_bg_frame_new (slot->ioq->fs);
+	if (!frame)
+		goto enomem;
+
+	switch (req->op) {
+	case GLFS_IOQ_READ:
+		if (req->iovcnt <= GLFS_IOQ_INLINE_IOV) {
+			memcpy (slot->iov_inline, req->iov,
+				req->iovcnt * sizeof (*req->iov));
+			slot->iov = slot->iov_inline;
+		} else {
+			slot->iov = iov_dup (req->iov, req->iovcnt);
+			if (!slot->iov)
+				goto enomem;
+		}
+		slot->count = req->iovcnt;
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
+		frame->local = slot;
+		STACK_WIND (frame, glfs_ioq_readv_cbk, subvol,
+			    subvol->fops->readv, fd, size, req->offset,
+			    req->flags, NULL);
+		break;
 
-	if (ret == 0)
-		ret = glfs_loc_unlink (&loc);
-out:
-	loc_wipe (&loc);
+	case GLFS_IOQ_WRITE:
+		iobuf = iobuf_get2 (subvol->ctx->iobuf_pool, size);
+		if (!iobuf)
+			goto enomem;
 
-	glfs_subvol_done (fs, subvol);
+		iobref = iobref_new ();
+		if (!iobref)
+			goto enomem;
 
-	return ret;
+		if (iobref_add (iobref, iobuf))
+			goto enomem;
+
+		iov_unload (iobuf_ptr (iobuf), req->iov, req->iovcnt);
+
+		iov.iov_base = iobuf_ptr (iobuf);
+		iov.iov_len = size;
+
+		frame->local = slot;
+		STACK_WIND (frame, glfs_ioq_writev_cbk, subvol,
+			    subvol->fops->writev, fd, &iov, 1, req->offset,
+			    req->flags, iobref, NULL);
+
+		iobuf_unref (iobuf);
+		iobref_unref (iobref);
+		break;
+
+	case GLFS_IOQ_FSYNC:
+	case GLFS_IOQ_FDATASYNC:
+		frame->local = slot;
+		STACK_WIND (frame, glfs_ioq_fsync_cbk, subvol,
+			    subvol->fops->fsync, fd,
+			    (req->op == GLFS_IOQ_FDATASYNC), NULL);
+		break;
+	}
+
+	return;
+enomem:
+	if (iobuf)
+		iobuf_unref (iobuf);
+	if (iobref)
+		iobref_unref (iobref);
+	if (frame)
+		glfs_bg_frame_destroy (slot->ioq->fs, frame);
+
+	glfs_ioq_complete (slot, -1, ENOMEM);
 }
 
 
 int
-glfs_rename (struct glfs *fs, const char *oldpath, const char *newpath)
+glfs_ioq_submit (struct glfs_ioq *ioq, struct glfs_ioreq *reqs, int nr)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            oldloc = {0, };
-	loc_t            newloc = {0, };
-	struct iatt      oldiatt = {0, };
-	struct iatt      newiatt = {0, };
-	int              reval = 0;
+	struct glfs           *fs = NULL;
+	xlator_t              *subvol = NULL;
+	struct glfs_ioq_slot  *slot = NULL;
+	struct glfs_ioreq     *req = NULL;
+	struct glfs_fd        *glfd = NULL;
+	fd_t                  *fd = NULL;
+	int                    i = 0;
+
+	if (!ioq || !reqs || nr < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (!reqs[i].fd || reqs[i].op < GLFS_IOQ_READ ||
+		    reqs[i].op > GLFS_IOQ_FDATASYNC) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	fs = ioq->fs;
 
 	__glfs_entry_fs (fs);
 
+	/* The subvol, and the fd of consecutive requests on the same
+	   glfd, are resolved once for the whole batch.
+	*/
 	subvol = glfs_active_subvol (fs);
 	if (!subvol) {
-		ret = -1;
 		errno = EIO;
-		goto out;
+		return -1;
 	}
-retry:
-	ret = glfs_lresolve (fs, subvol, oldpath, &oldloc, &oldiatt, reval);
-
-	ESTALE_RETRY (ret, errno, reval, &oldloc, retry);
 
-	if (ret)
-		goto out;
-retrynew:
-	ret = glfs_lresolve (fs, subvol, newpath, &newloc, &newiatt, reval);
+	for (i = 0; i < nr; i++) {
+		req = &reqs[i];
 
-	ESTALE_RETRY (ret, errno, reval, &newloc, retrynew);
+		slot = glfs_ioq_slot_get (ioq);
+		if (!slot)
+			break;
 
-	if (ret && errno != ENOENT && newloc.parent)
-		goto out;
+		if (req->fd != glfd) {
+			if (fd)
+				fd_unref (fd);
+			glfd = req->fd;
+			fd = glfs_resolve_fd (fs, subvol, glfd);
+			if (fd)
+				glfs_wb_flush (glfd, subvol, fd);
+		}
 
-	if (newiatt.ia_type != IA_INVAL) {
-                if ((oldiatt.ia_type == IA_IFDIR) !=
-                    (newiatt.ia_type == IA_IFDIR)) {
-                       /* Either both old and new must be dirs,
-                        * or both must be non-dirs. Else, fail.
-                        */
-                       ret = -1;
-                       errno = EISDIR;
-                       goto out;
-                }
-        }
+		slot->glfd = req->fd;
+		slot->op = req->op;
+		slot->offset = req->offset;
+		slot->data = req->data;
 
-	/* TODO: check if new or old is a prefix of the other, and fail EINVAL */
+		if (!fd) {
+			glfs_ioq_complete (slot, -1, EBADFD);
+			continue;
+		}
 
-	ret = syncop_rename (subvol, &oldloc, &newloc);
+		slot->fd = fd_ref (fd);
+		slot->subvol = glfs_subvol_hold (subvol);
 
-	if (ret == -1 && errno == ESTALE) {
-		if (reval < DEFAULT_REVAL_COUNT) {
-			reval++;
-			loc_wipe (&oldloc);
-			loc_wipe (&newloc);
-			goto retry;
-		}
+		glfs_ioq_wind (slot, req);
 	}
 
-	if (ret == 0)
-		inode_rename (oldloc.parent->table, oldloc.parent, oldloc.name,
-			      newloc.parent, newloc.name, oldloc.inode,
-			      &oldiatt);
-out:
-	loc_wipe (&oldloc);
-	loc_wipe (&newloc);
+	if (fd)
+		fd_unref (fd);
 
 	glfs_subvol_done (fs, subvol);
 
-	return ret;
+	if (nr && !i) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return i;
 }
 
 
 int
-glfs_link (struct glfs *fs, const char *oldpath, const char *newpath)
+glfs_ioq_getevents (struct glfs_ioq *ioq, int min_nr, int max_nr,
+		    struct glfs_ioevent *events, struct timespec *timeout)
 {
-	int              ret = -1;
-	xlator_t        *subvol = NULL;
-	loc_t            oldloc = {0, };
-	loc_t            newloc = {0, };
-	struct iatt      oldiatt = {0, };
-	struct iatt      newiatt = {0, };
-	int              reval = 0;
-
-	__glfs_entry_fs (fs);
+	struct timespec  abstime = {0, };
+	int              ret = 0;
+	int              i = 0;
 
-	subvol = glfs_active_subvol (fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
+	if (!ioq || !events || min_nr < 0 || max_nr < min_nr) {
+		errno = EINVAL;
+		return -1;
 	}
-retry:
-	ret = glfs_lresolve (fs, subvol, oldpath, &oldloc, &oldiatt, reval);
 
-	ESTALE_RETRY (ret, errno, reval, &oldloc, retry);
-
-	if (ret)
-		goto out;
-retrynew:
-	ret = glfs_lresolve (fs, subvol, newpath, &newloc, &newiatt, reval);
+	if (timeout) {
+		clock_gettime (CLOCK_REALTIME, &abstime);
+		abstime.tv_sec += timeout->tv_sec;
+		abstime.tv_nsec += timeout->tv_nsec;
+		if (abstime.tv_nsec >= 1000000000) {
+			abstime.tv_sec++;
+			abstime.tv_nsec -= 1000000000;
+		}
+	}
 
-	ESTALE_RETRY (ret, errno, reval, &newloc, retrynew);
+	pthread_mutex_lock (&ioq->mutex);
+	{
+		/* do not wait for events which can never arrive */
+		while (ioq->nevents < min_nr &&
+		       ioq->nevents + ioq->inflight >= min_nr) {
+			if (!timeout) {
+				pthread_cond_wait (&ioq->cond, &ioq->mutex);
+				continue;
+			}
+
+			ret = pthread_cond_timedwait (&ioq->cond, &ioq->mutex,
+						      &abstime);
+			if (ret == ETIMEDOUT)
+				break;
+		}
 
-	if (ret == 0) {
-		ret = -1;
-		errno = EEXIST;
-		goto out;
+		for (i = 0; i < max_nr && ioq->nevents; i++) {
+			events[i] = ioq->events[ioq->head];
+			ioq->head = (ioq->head + 1) % ioq->depth;
+			ioq->nevents--;
+		}
 	}
+	pthread_mutex_unlock (&ioq->mutex);
 
-	if (oldiatt.ia_type == IA_IFDIR) {
-		ret = -1;
-		errno = EISDIR;
-		goto out;
-	}
+	return i;
+}
 
-        /* Filling the inode of the hard link to be same as that of the
-           original file
-        */
-	if (newloc.inode) {
-		inode_unref (newloc.inode);
-		newloc.inode = NULL;
+
+int
+glfs_ioq_destroy (struct glfs_ioq *ioq)
+{
+	if (!ioq) {
+		errno = EINVAL;
+		return -1;
 	}
-        newloc.inode = inode_ref (oldloc.inode);
-
-	ret = syncop_link (subvol, &oldloc, &newloc);
 
-	if (ret == -1 && errno == ESTALE) {
-		loc_wipe (&oldloc);
-		loc_wipe (&newloc);
-		if (reval--)
-			goto retry;
+	pthread_mutex_lock (&ioq->mutex);
+	{
+		while (ioq->inflight)
+			pthread_cond_wait (&ioq->cond, &ioq->mutex);
 	}
+	pthread_mutex_unlock (&ioq->mutex);
 
-	if (ret == 0)
-		ret = glfs_loc_link (&newloc, &oldiatt);
-out:
-	loc_wipe (&oldloc);
-	loc_wipe (&newloc);
+	pthread_mutex_destroy (&ioq->mutex);
+	pthread_cond_destroy (&ioq->cond);
 
-	glfs_subvol_done (fs, subvol);
+	GF_FREE (ioq->slots);
+	GF_FREE (ioq->events);
+	GF_FREE (ioq);
 
-	return ret;
+	return 0;
 }
 
 
-struct glfs_fd *
-glfs_opendir (struct glfs *fs, const char *path)
+void
+gf_dirent_to_dirent (gf_dirent_t *gf_dirent, struct dirent *dirent)
 {
-	int              ret = -1;
-	struct glfs_fd  *glfd = NULL;
-	xlator_t        *subvol = NULL;
-	loc_t            loc = {0, };
-	struct iatt      iatt = {0, };
-	int              reval = 0;
+	dirent->d_ino = gf_dirent->d_ino;
 
-	__glfs_entry_fs (fs);
+#ifdef _DIRENT_HAVE_D_OFF
+	dirent->d_off = gf_dirent->d_off;
+#endif
 
-	subvol = glfs_active_subvol (fs);
-	if (!subvol) {
-		ret = -1;
-		errno = EIO;
-		goto out;
-	}
+#ifdef _DIRENT_HAVE_D_TYPE
+	dirent->d_type = gf_dirent->d_type;
+#endif
 
-	glfd = glfs_fd_new (fs);
-	if (!glfd)
-		goto out;
+#ifdef _DIRENT_HAVE_D_NAMLEN
+	dirent->d_namlen = strlen (gf_dirent->d_name);
+#endif
 
-	INIT_LIST_HEAD (&glfd->entries);
-retry:
-	ret = glfs_resolve (fs, subvol, path, &loc, &iatt, reval);
+	strncpy (dirent->d_name, gf_dirent->d_name, 256);
+}
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 
-	if (ret)
-		goto out;
+/* The next batch of a directory, read while the current one is being
+   consumed */
+struct glfs_rda {
+	pthread_mutex_t      mutex;
+	pthread_cond_t       cond;
+	int                  busy;
+	int                  valid;
+	int                  plus;
+	off_t                offset;
+	int                  ret;
+	xlator_t            *subvol; /* @entries were read through these, */
+	fd_t                *fd;     /* held until the batch is taken */
+	struct glfs         *fs;
+	gf_dirent_t          entries;
+};
 
-	if (!IA_ISDIR (iatt.ia_type)) {
-		ret = -1;
-		errno = ENOTDIR;
-		goto out;
-	}
 
-	if (glfd->fd) {
-		/* Retry. Safe to touch glfd->fd as we
-		   still have not glfs_fd_bind() yet.
-		*/
-		fd_unref (glfd->fd);
-		glfd->fd = NULL;
-	}
+/* Under @rda->mutex. The refs are handed to the caller to drop. */
+static void
+__glfs_rda_release (struct glfs_rda *rda, xlator_t **subvolp, fd_t **fdp)
+{
+	*subvolp = rda->subvol;
+	*fdp = rda->fd;
 
-	glfd->fd = fd_create (loc.inode, getpid());
-	if (!glfd->fd) {
-		ret = -1;
-		errno = ENOMEM;
-		goto out;
-	}
+	rda->subvol = NULL;
+	rda->fd = NULL;
+	rda->valid = 0;
+	gf_dirent_free (&rda->entries);
+}
 
-	ret = syncop_opendir (subvol, &loc, glfd->fd);
 
-	ESTALE_RETRY (ret, errno, reval, &loc, retry);
-out:
-	loc_wipe (&loc);
+static int
+glfs_rda_cbk (call_frame_t *frame, void *cookie, xlator_t *this,
+	      int32_t op_ret, int32_t op_errno, gf_dirent_t *entries,
+	      dict_t *xdata)
+{
+	struct glfs_rda *rda = NULL;
+	struct glfs     *fs = NULL;
+	gf_dirent_t     *entry = NULL;
+	gf_dirent_t     *tmp = NULL;
+
+	rda = frame->local;
+	frame->local = NULL;
+	fs = rda->fs;
+
+	pthread_mutex_lock (&rda->mutex);
+	{
+		rda->ret = op_ret;
+		if (op_ret > 0) {
+			/* take the entries over instead of copying them */
+			list_for_each_entry_safe (entry, tmp, &entries->list,
+						  list) {
+				list_del_init (&entry->list);
+				list_add_tail (&entry->list,
+					       &rda->entries.list);
+			}
+		}
 
-	if (ret && glfd) {
-		glfs_fd_destroy (glfd);
-		glfd = NULL;
-	} else {
-		fd_bind (glfd->fd);
-		glfs_fd_bind (glfd);
+		rda->valid = (op_ret >= 0);
+		rda->busy = 0;
+		pthread_cond_signal (&rda->cond);
 	}
+	pthread_mutex_unlock (&rda->mutex);
 
-	glfs_subvol_done (fs, subvol);
+	glfs_bg_frame_destroy (fs, frame);
 
-	return glfd;
+	return 0;
 }
 
 
-int
-glfs_closedir (struct glfs_fd *glfd)
+static struct glfs_rda *
+glfs_rda_get (struct glfs_fd *glfd)
 {
-	__glfs_entry_fd (glfd);
+	struct glfs_rda *rda = NULL;
 
-	gf_dirent_free (list_entry (&glfd->entries, gf_dirent_t, list));
+	if (glfd->rda)
+		return glfd->rda;
 
-	glfs_fd_destroy (glfd);
+	rda = GF_CALLOC (1, sizeof (*rda), glfs_mt_glfs_rda_t);
+	if (!rda)
+		return NULL;
 
-	return 0;
-}
+	pthread_mutex_init (&rda->mutex, NULL);
+	pthread_cond_init (&rda->cond, NULL);
+	INIT_LIST_HEAD (&rda->entries.list);
+	rda->fs = glfd->fs;
 
+	glfd->rda = rda;
 
-long
-glfs_telldir (struct glfs_fd *fd)
-{
-	return fd->offset;
+	return rda;
 }
 
 
-void
-glfs_seekdir (struct glfs_fd *fd, long offset)
+static void
+glfs_rda_wind (struct glfs_rda *rda, xlator_t *subvol, fd_t *fd,
+	       off_t offset, int plus)
 {
-	gf_dirent_t *entry = NULL;
-	gf_dirent_t *tmp = NULL;
+	call_frame_t *frame = NULL;
+	size_t        size = 0;
 
-	if (fd->offset == offset)
+	frame = glfs_bg_frame_new (rda->fs);
+	if (!frame)
 		return;
 
-	fd->offset = offset;
-	fd->next = NULL;
+	rda->busy = 1;
+	rda->valid = 0;
+	rda->plus = plus;
+	rda->offset = offset;
+	rda->subvol = glfs_subvol_hold (subvol);
+	rda->fd = fd_ref (fd);
+	frame->local = rda;
 
-	list_for_each_entry_safe (entry, tmp, &fd->entries, list) {
-		if (entry->d_off != offset)
-			continue;
+	size = rda->fs->readdir_size;
 
-		if (&tmp->list != &fd->entries) {
-			/* found! */
-			fd->next = tmp;
-			return;
-		}
-	}
-	/* could not find entry at requested offset in the cache.
-	   next readdir_r() will result in glfd_entry_refresh()
-	*/
+	if (plus)
+		STACK_WIND (frame, glfs_rda_cbk, subvol,
+			    subvol->fops->readdirp, fd, size, offset, NULL);
+	else
+		STACK_WIND (frame, glfs_rda_cbk, subvol,
+			    subvol->fops->readdir, fd, size, offset, NULL);
 }
 
-int
-glfs_discard_async (struct glfs_fd *glfd, off_t offset, size_t len,
-		      glfs_io_cbk fn, void *data)
-{
-	struct glfs_io *gio = NULL;
-	int             ret = 0;
 
-	gio = GF_CALLOC (1, sizeof (*gio), glfs_mt_glfs_io_t);
-	if (!gio) {
-		errno = ENOMEM;
-		return -1;
-	}
+/* Moves the prefetched batch to @entries if it was read from @offset
+   through @fd, so its inodes belong to the table of @fd and not to the
+   one of an older graph, and returns its readdir result, or -1 if there
+   is none to use. */
+static int
+glfs_rda_take (struct glfs_rda *rda, fd_t *fd, off_t offset, int plus,
+	       gf_dirent_t *entries)
+{
+	int        ret = -1;
+	xlator_t  *subvol = NULL;
+	fd_t      *old_fd = NULL;
 
-	gio->op     = GF_FOP_DISCARD;
-	gio->glfd   = glfd;
-	gio->offset = offset;
-	gio->count  = len;
-	gio->fn     = fn;
-	gio->data   = data;
+	pthread_mutex_lock (&rda->mutex);
+	{
+		while (rda->busy)
+			pthread_cond_wait (&rda->cond, &rda->mutex);
 
-	ret = synctask_new (glfs_from_glfd (glfd)->ctx->env,
-			    glfs_io_async_task, glfs_io_async_cbk,
-			    NULL, gio);
+		if (rda->valid && rda->fd == fd && rda->offset == offset &&
+		    rda->plus == plus) {
+			list_splice_init (&rda->entries.list, &entries->list);
+			ret = rda->ret;
+		}
 
-	if (ret) {
-		GF_FREE (gio->iov);
-		GF_FREE (gio);
+		__glfs_rda_release (rda, &subvol, &old_fd);
 	}
+	pthread_mutex_unlock (&rda->mutex);
+
+	if (old_fd)
+		fd_unref (old_fd);
+	glfs_subvol_done (rda->fs, subvol);
 
 	return ret;
 }
 
 
 void
-gf_dirent_to_dirent (gf_dirent_t *gf_dirent, struct dirent *dirent)
+glfs_rda_destroy (struct glfs_fd *glfd)
 {
-	dirent->d_ino = gf_dirent->d_ino;
+	struct glfs_rda *rda = NULL;
+	xlator_t        *subvol = NULL;
+	fd_t            *fd = NULL;
 
-#ifdef _DIRENT_HAVE_D_OFF
-	dirent->d_off = gf_dirent->d_off;
-#endif
+	rda = glfd->rda;
+	if (!rda)
+		return;
 
-#ifdef _DIRENT_HAVE_D_TYPE
-	dirent->d_type = gf_dirent->d_type;
-#endif
+	pthread_mutex_lock (&rda->mutex);
+	{
+		while (rda->busy)
+			pthread_cond_wait (&rda->cond, &rda->mutex);
 
-#ifdef _DIRENT_HAVE_D_NAMLEN
-	dirent->d_namlen = strlen (gf_dirent->d_name);
-#endif
+		__glfs_rda_release (rda, &subvol, &fd);
+	}
+	pthread_mutex_unlock (&rda->mutex);
 
-	strncpy (dirent->d_name, gf_dirent->d_name, 256);
+	if (fd)
+		fd_unref (fd);
+	glfs_subvol_done (glfd->fs, subvol);
+
+	pthread_mutex_destroy (&rda->mutex);
+	pthread_cond_destroy (&rda->cond);
+	GF_FREE (rda);
+
+	glfd->rda = NULL;
+}
+
+
+/* gf_link_inodes_from_dirent(), tracking the inodes new to the table
+   in the same pass, those already there were tracked when linked */
+static void
+glfs_link_inodes_from_dirent (struct glfs *fs, inode_t *parent,
+			      gf_dirent_t *entries)
+{
+	gf_dirent_t *entry = NULL;
+	inode_t     *link_inode = NULL;
+
+	list_for_each_entry (entry, &entries->list, list) {
+		if (!entry->inode)
+			continue;
+
+		link_inode = inode_link (entry->inode, parent, entry->d_name,
+					 &entry->d_stat);
+		if (!link_inode)
+			continue;
+
+		inode_lookup (link_inode);
+		if (link_inode == entry->inode)
+			glfs_inode_track (fs, link_inode);
+		inode_unref (link_inode);
+	}
 }
 
 
@@ -1822,6 +4647,8 @@ glfd_entry_refresh (struct glfs_fd *glfd, int plus)
 	xlator_t        *subvol = NULL;
 	gf_dirent_t      entries;
 	gf_dirent_t      old;
+	gf_dirent_t     *last = NULL;
+	struct glfs_rda *rda = NULL;
 	int              ret = -1;
 	fd_t            *fd = NULL;
 
@@ -1848,26 +4675,59 @@ glfd_entry_refresh (struct glfs_fd *glfd, int plus)
 	INIT_LIST_HEAD (&entries.list);
 	INIT_LIST_HEAD (&old.list);
 
-	if (plus)
-		ret = syncop_readdirp (subvol, fd, 131072, glfd->offset,
-				       NULL, &entries);
-	else
-		ret = syncop_readdir (subvol, fd, 131072, glfd->offset,
-				      &entries);
+	rda = glfs_rda_get (glfd);
+
+	ret = -1;
+	if (rda)
+		ret = glfs_rda_take (rda, fd, glfd->offset, plus, &entries);
+
+	if (ret < 0) {
+		if (plus)
+			ret = syncop_readdirp (subvol, fd,
+					       glfd->fs->readdir_size,
+					       glfd->offset, NULL, &entries);
+		else
+			ret = syncop_readdir (subvol, fd,
+					      glfd->fs->readdir_size,
+					      glfd->offset, &entries);
+	}
 	if (ret >= 0) {
 		if (plus)
-			gf_link_inodes_from_dirent (THIS, fd->inode, &entries);
-
-		list_splice_init (&glfd->entries, &old.list);
+			glfs_link_inodes_from_dirent (glfd->fs, fd->inode,
+						      &entries);
+
+		/* the current batch becomes the previous one if the new
+		   batch continues it, after a seekdir() elsewhere the two
+		   are unrelated and it is dropped as well */
+		list_splice_init (&glfd->prev_entries, &old.list);
+		last = NULL;
+		if (!list_empty (&glfd->entries))
+			last = list_entry (glfd->entries.prev, gf_dirent_t,
+					   list);
+		if (last && last->d_off == glfd->offset) {
+			glfd_batch_swap (glfd);
+		} else {
+			list_splice_init (&glfd->entries, &old.list);
+			glfs_dirindex_build (&glfd->prev_index,
+					     &glfd->prev_entries);
+		}
 		list_splice_init (&entries.list, &glfd->entries);
+		glfs_dirindex_build (&glfd->index, &glfd->entries);
+		glfd->prev_follows = 0;
 
 		/* spurious errno is dangerous for glfd_entry_next() */
 		errno = 0;
 	}
 
-	if (ret > 0)
+	if (ret > 0) {
 		glfd->next = list_entry (glfd->entries.next, gf_dirent_t, list);
 
+		/* fetch the next batch while this one is consumed */
+		last = list_entry (glfd->entries.prev, gf_dirent_t, list);
+		if (rda)
+			glfs_rda_wind (rda, subvol, fd, last->d_off, plus);
+	}
+
 	gf_dirent_free (&old);
 out:
 	if (fd)
@@ -1879,10 +4739,11 @@ out:
 }
 
 
-gf_dirent_t *
-glfd_entry_next (struct glfs_fd *glfd, int plus)
+/* Returns the next entry without consuming it, reading the next batch
+   when needed. NULL at the end or on error (with @errno set). */
+static gf_dirent_t *
+glfd_entry_peek (struct glfs_fd *glfd, int plus)
 {
-	gf_dirent_t     *entry = NULL;
 	int              ret = -1;
 
 	if (!glfd->offset || !glfd->next) {
@@ -1891,16 +4752,39 @@ glfd_entry_next (struct glfs_fd *glfd, int plus)
 			return NULL;
 	}
 
-	entry = glfd->next;
-	if (!entry)
-		return NULL;
+	return glfd->next;
+}
 
-	if (&entry->next->list == &glfd->entries)
-		glfd->next = NULL;
-	else
+
+static void
+glfd_entry_advance (struct glfs_fd *glfd, gf_dirent_t *entry)
+{
+	if (&entry->next->list != &glfd->entries) {
 		glfd->next = entry->next;
+	} else if (glfd->prev_follows && !list_empty (&glfd->prev_entries)) {
+		/* seekdir() went back a batch, the one after is cached */
+		glfd_batch_swap (glfd);
+		glfd->prev_follows = 0;
+		glfd->next = list_entry (glfd->entries.next, gf_dirent_t,
+					 list);
+	} else {
+		glfd->next = NULL;
+	}
 
 	glfd->offset = entry->d_off;
+}
+
+
+gf_dirent_t *
+glfd_entry_next (struct glfs_fd *glfd, int plus)
+{
+	gf_dirent_t     *entry = NULL;
+
+	entry = glfd_entry_peek (glfd, plus);
+	if (!entry)
+		return NULL;
+
+	glfd_entry_advance (glfd, entry);
 
 	return entry;
 }
@@ -1944,6 +4828,95 @@ glfs_readdir_r (struct glfs_fd *glfd, struct dirent *buf, struct dirent **res)
 }
 
 
+int
+glfs_readdirplus_batch (struct glfs_fd *glfd, struct glfs_direntplus *entries,
+			int nr)
+{
+	gf_dirent_t     *entry = NULL;
+	int              i = 0;
+
+	__glfs_entry_fd (glfd);
+
+	for (i = 0; i < nr; i++) {
+		errno = 0;
+		entry = glfd_entry_next (glfd, 1);
+		if (!entry)
+			break;
+
+		gf_dirent_to_dirent (entry, &entries[i].dirent);
+		glfs_iatt_to_stat (glfd->fs, &entry->d_stat,
+				   &entries[i].stat);
+	}
+
+	/* an error after some entries is returned by the next call */
+	if (!i && errno)
+		return -1;
+
+	return i;
+}
+
+
+ssize_t
+glfs_getdents (struct glfs_fd *glfd, void *buf, size_t size, int flags)
+{
+	gf_dirent_t        *entry = NULL;
+	struct glfs_dirent *rec = NULL;
+	size_t              used = 0;
+	size_t              namelen = 0;
+	size_t              reclen = 0;
+	size_t              statoff = 0;
+
+	__glfs_entry_fd (glfd);
+
+	for (;;) {
+		errno = 0;
+		entry = glfd_entry_peek (glfd, 1);
+		if (!entry)
+			break;
+
+		namelen = strlen (entry->d_name);
+		statoff = GLFS_DIRENT_ALIGN (offsetof (struct glfs_dirent,
+						       d_name) + namelen + 1);
+		reclen = statoff;
+		if (flags & GLFS_GETDENTS_STAT)
+			reclen += GLFS_DIRENT_ALIGN (sizeof (struct stat));
+
+		if (used + reclen > size) {
+			if (!used)
+				errno = EINVAL;
+			break;
+		}
+
+		rec = (struct glfs_dirent *) ((char *) buf + used);
+
+		rec->d_ino = entry->d_ino;
+		rec->d_off = entry->d_off;
+		rec->d_reclen = reclen;
+		rec->d_namelen = namelen;
+		rec->d_type = entry->d_type;
+		rec->d_flags = 0;
+		memcpy (rec->d_gfid, entry->d_stat.ia_gfid, 16);
+		memcpy (rec->d_name, entry->d_name, namelen + 1);
+
+		if (flags & GLFS_GETDENTS_STAT) {
+			glfs_iatt_to_stat (glfd->fs, &entry->d_stat,
+					   (struct stat *) ((char *) rec +
+							    statoff));
+			rec->d_flags |= GLFS_DIRENT_HAS_STAT;
+		}
+
+		used += reclen;
+		glfd_entry_advance (glfd, entry);
+	}
+
+	/* an error after some entries is returned by the next call */
+	if (!used && errno)
+		return -1;
+
+	return used;
+}
+
+
 int
 glfs_statvfs (struct glfs *fs, const char *path, struct statvfs *buf)
 {
@@ -2012,6 +4985,8 @@ retry:
 
 	ret = syncop_setattr (subvol, &loc, iatt, valid, 0, 0);
 
+	glfs_loc_invalidate (fs, &loc);
+
 	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 out:
 	loc_wipe (&loc);
@@ -2046,6 +5021,8 @@ glfs_fsetattr (struct glfs_fd *glfd, struct iatt *iatt, int valid)
 	}
 
 	ret = syncop_fsetattr (subvol, fd, iatt, valid, 0, 0);
+	glfs_iatt_cache_invalidate (glfd->fs, fd->inode);
+	glfs_ra_invalidate (glfd);
 out:
 	if (fd)
 		fd_unref (fd);
@@ -2706,7 +5683,13 @@ glfs_fallocate (struct glfs_fd *glfd, int keep_size, off_t offset, size_t len)
 		goto out;
 	}
 
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
 	ret = syncop_fallocate (subvol, fd, keep_size, offset, len);
+	glfs_iatt_cache_invalidate (glfd->fs, fd->inode);
+	glfs_ra_invalidate (glfd);
 out:
 	if (fd)
 		fd_unref(fd);
@@ -2740,7 +5723,13 @@ glfs_discard (struct glfs_fd *glfd, off_t offset, size_t len)
 		goto out;
 	}
 
+	ret = glfs_wb_sync (glfd, subvol, fd);
+	if (ret)
+		goto out;
+
 	ret = syncop_discard (subvol, fd, offset, len);
+	glfs_iatt_cache_invalidate (glfd->fs, fd->inode);
+	glfs_ra_invalidate (glfd);
 out:
 	if (fd)
 		fd_unref(fd);
@@ -50,12 +50,26 @@ glfs_iatt_from_stat (struct stat *sb, int valid, struct iatt *iatt,
 	return;
 }
 
+static struct glfs_object *
+glfs_h_object_alloc (void)
+{
+	struct glfs_object *object = NULL;
+
+	object = GF_CALLOC (1, sizeof (struct glfs_object),
+			    glfs_mt_glfs_object_t);
+	if (object)
+		LOCK_INIT (&object->lock);
+
+	return object;
+}
+
 struct glfs_object *
 glfs_h_lookupat (struct glfs *fs, struct glfs_object *parent, 
 		 const char *path, struct stat *stat)
 {
 	int                      ret = 0;
 	xlator_t                *subvol = NULL;
+	inode_t                 *inode = NULL;
 	struct iatt              iatt = {0, };
 	struct glfs_object      *object = NULL;
 	loc_t                    loc = {0, };
@@ -69,20 +83,23 @@ glfs_h_lookupat (struct glfs *fs, struct glfs_object *parent,
 		goto out;
 	}
 
-	/* validate object inodes that are in args */
-	if (parent) {
-		glfs_validate_inode (fs, parent);
+	/* get the inode of the object on the active graph */
+	if (parent != NULL) {
+		inode = glfs_resolve_inode (fs, subvol, parent);
+		if (!inode) {
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
 	/* TODO: in args validation. */
 	/* TODO: stale error handling? */
-	ret = glfs_resolve_at (fs, subvol, (parent? parent->inode : NULL), 
+	ret = glfs_resolve_at (fs, subvol, inode, 
 			       path, &loc, &iatt, 0 /*TODO: links? */, 0);
 
 	if (!ret) {
 		/* allocate a return object */
-		object = GF_CALLOC (1, sizeof(struct glfs_object), 
-				    glfs_mt_glfs_object_t);
+		object = glfs_h_object_alloc ();
 		if (object == NULL) {
 			errno = ENOMEM;
 			goto out;
@@ -100,6 +117,9 @@ glfs_h_lookupat (struct glfs *fs, struct glfs_object *parent,
 	}
 
 out:
+	if (inode)
+		inode_unref (inode);
+
 	loc_wipe (&loc);
 	glfs_subvol_done (fs, subvol);
 
@@ -112,6 +132,7 @@ glfs_h_getattrs (struct glfs *fs, struct glfs_object *object,
 {
 	int                      ret = 0;
 	xlator_t                *subvol = NULL;
+	inode_t                 *inode = NULL;
 	struct iatt              iatt = {0, };
 
 	__glfs_entry_fs (fs);
@@ -124,21 +145,29 @@ glfs_h_getattrs (struct glfs *fs, struct glfs_object *object,
 		goto out;
 	}
 
-	/* validate object inodes that are in args */
-	if (object) {
-		glfs_validate_inode (fs, object);
+	/* get the inode of the object on the active graph */
+	if (object != NULL) {
+		inode = glfs_resolve_inode (fs, subvol, object);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
 	/* TODO: in args validation. */
 	/* TODO: stale error handling? */
 	/* TODO: No error returned from glfs_resolve_base? */
-	glfs_resolve_base (fs, subvol, object->inode, &iatt);
+	glfs_resolve_base (fs, subvol, inode, &iatt);
 	//if (!ret) {
 		/* populate stat */
 		glfs_iatt_to_stat (fs, &iatt, stat);
 	//}
 
 out:
+	if (inode)
+		inode_unref (inode);
+
 	glfs_subvol_done (fs, subvol);
 
 	return ret;
@@ -150,6 +179,7 @@ glfs_h_setattrs (struct glfs *fs, struct glfs_object *object, struct stat *sb,
 {
 	int              ret = -1;
 	xlator_t        *subvol = NULL;
+	inode_t         *inode = NULL;
 	loc_t            loc = {0, };
 	struct iatt      iatt = {0, };
 	int              reval = 0;
@@ -168,15 +198,20 @@ glfs_h_setattrs (struct glfs *fs, struct glfs_object *object, struct stat *sb,
 	/* map valid masks from in args */
 	glfs_iatt_from_stat (sb, valid, &iatt, &glvalid);
 
-retry:
-	/* validate object inodes that are in args */
-	if (object) {
-		glfs_validate_inode (fs, object);
+	/* get the inode of the object on the active graph */
+	if (object != NULL) {
+		inode = glfs_resolve_inode (fs, subvol, object);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
+retry:
 	/* TODO: do we need the UUID copied? */
-	loc.inode = inode_ref (object->inode);
-	uuid_copy (loc.gfid, object->inode->gfid);
+	loc.inode = inode_ref (inode);
+	uuid_copy (loc.gfid, inode->gfid);
 	ret = glfs_loc_touchup (&loc);
 	if (ret != 0) {
 		errno = EINVAL;
@@ -185,8 +220,13 @@ retry:
 
 	ret = syncop_setattr (subvol, &loc, &iatt, glvalid, 0, 0);
 
+	glfs_loc_invalidate (fs, &loc);
+
 	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 out:
+	if (inode)
+		inode_unref (inode);
+
 	loc_wipe (&loc);
 
 	glfs_subvol_done (fs, subvol);
@@ -200,6 +240,7 @@ glfs_h_open (struct glfs *fs, struct glfs_object *object, int flags)
 	int              ret = -1;
 	struct glfs_fd  *glfd = NULL;
 	xlator_t        *subvol = NULL;
+	inode_t         *inode = NULL;
 	loc_t            loc = {0, };
 	int              reval = 0;
 
@@ -223,20 +264,24 @@ glfs_h_open (struct glfs *fs, struct glfs_object *object, int flags)
 		goto out;
 	}
 
-retry:
-	/* TODO: should this be done on the retry as well? */
-	/* validate object inodes that are in args */
-	if (object) {
-		glfs_validate_inode (fs, object);
+	/* get the inode of the object on the active graph */
+	if (object != NULL) {
+		inode = glfs_resolve_inode (fs, subvol, object);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
-	if (IA_ISDIR (object->inode->ia_type)) {
+retry:
+	if (IA_ISDIR (inode->ia_type)) {
 		ret = -1;
 		errno = EISDIR;
 		goto out;
 	}
 
-	if (!IA_ISREG (object->inode->ia_type)) {
+	if (!IA_ISREG (inode->ia_type)) {
 		ret = -1;
 		errno = EINVAL;
 		goto out;
@@ -250,14 +295,14 @@ retry:
 		glfd->fd = NULL;
 	}
 
-	glfd->fd = fd_create (object->inode, getpid());
+	glfd->fd = fd_create (inode, getpid());
 	if (!glfd->fd) {
 		ret = -1;
 		errno = ENOMEM;
 		goto out;
 	}
 
-	loc.inode = inode_ref (object->inode);
+	loc.inode = inode_ref (inode);
 	ret = glfs_loc_touchup (&loc);
 	if (ret != 0) {
 		errno = EINVAL;
@@ -265,10 +310,15 @@ retry:
 	}
 
 	ret = syncop_open (subvol, &loc, flags, glfd->fd);
+	if (flags & O_TRUNC)
+		glfs_iatt_cache_invalidate (fs, loc.inode);
 
 	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 
 out:
+	if (inode)
+		inode_unref (inode);
+
 	loc_wipe (&loc);
 
 	if (ret && glfd) {
@@ -291,6 +341,7 @@ glfs_h_creat (struct glfs *fs, struct glfs_object *parent, const char *path,
 	int                 ret = -1;
 	struct glfs_fd     *glfd = NULL;
 	xlator_t           *subvol = NULL;
+	inode_t            *inode = NULL;
 	loc_t               loc = {0, };
 	struct iatt         iatt = {0, };
 	uuid_t              gfid;
@@ -326,18 +377,23 @@ glfs_h_creat (struct glfs *fs, struct glfs_object *parent, const char *path,
 	if (!glfd)
 		goto out;
 
-	/* validate object inodes that are in args */
+	/* get the inode of the object on the active graph */
 	if (parent != NULL) {
-		glfs_validate_inode (fs, parent);
+		inode = glfs_resolve_inode (fs, subvol, parent);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
-	loc.inode = inode_new (parent->inode->table);
+	loc.inode = inode_new (inode->table);
 	if (!loc.inode) {
 		ret = -1;
 		errno = ENOMEM;
 		goto out;
 	}
-	loc.parent = inode_ref (parent->inode);
+	loc.parent = inode_ref (inode);
 	loc.name = path;
 	ret = glfs_loc_touchup (&loc);
 	if (ret != 0) {
@@ -361,8 +417,9 @@ glfs_h_creat (struct glfs *fs, struct glfs_object *parent, const char *path,
 	/* TODO: Do we really need to pass in an fd, can we just pass NULL */
 	ret = syncop_create (subvol, &loc, flags, mode, glfd->fd,
 			     xattr_req, &iatt);
+	glfs_loc_invalidate (fs, &loc);
 	if (ret == 0) {
-		ret = glfs_loc_link (&loc, &iatt);
+		ret = glfs_loc_link (fs, &loc, &iatt);
 		if (ret != 0) {
 			goto out;
 		}
@@ -370,8 +427,7 @@ glfs_h_creat (struct glfs *fs, struct glfs_object *parent, const char *path,
 		glfs_iatt_to_stat (fs, &iatt, sb);
 
 		if (object == NULL) {
-			object = GF_CALLOC (1, sizeof(struct glfs_object), 
-					    glfs_mt_glfs_object_t);
+			object = glfs_h_object_alloc ();
 			if (object == NULL) {
 				errno = ENOMEM;
 				ret = -1;
@@ -387,6 +443,9 @@ glfs_h_creat (struct glfs *fs, struct glfs_object *parent, const char *path,
 	}
 	
 out:
+	if (inode)
+		inode_unref (inode);
+
 	if (ret && object != NULL) {
 		glfs_h_close (object);
 		object = NULL;
@@ -413,6 +472,7 @@ glfs_h_mkdir (struct glfs *fs, struct glfs_object *parent, const char *path,
 {
 	int                 ret = -1;
 	xlator_t           *subvol = NULL;
+	inode_t            *inode = NULL;
 	loc_t               loc = {0, };
 	struct iatt         iatt = {0, };
 	uuid_t              gfid;
@@ -444,19 +504,24 @@ glfs_h_mkdir (struct glfs *fs, struct glfs_object *parent, const char *path,
 		goto out;
 	}
 
-	/* validate object inodes that are in args */
+	/* get the inode of the object on the active graph */
 	if (parent != NULL) {
-		glfs_validate_inode (fs, parent);
+		inode = glfs_resolve_inode (fs, subvol, parent);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
-	loc.inode = inode_new (parent->inode->table);
+	loc.inode = inode_new (inode->table);
 	if (!loc.inode) {
 		ret = -1;
 		errno = ENOMEM;
 		goto out;
 	}
 
-	loc.parent = inode_ref (parent->inode);
+	loc.parent = inode_ref (inode);
 	loc.name = path;
 	ret = glfs_loc_touchup (&loc);
 	if (ret != 0) {
@@ -465,16 +530,16 @@ glfs_h_mkdir (struct glfs *fs, struct glfs_object *parent, const char *path,
 	}
 
 	ret = syncop_mkdir (subvol, &loc, mode, xattr_req, &iatt);
+	glfs_loc_invalidate (fs, &loc);
 	if ( ret == 0 )  {
-		ret = glfs_loc_link (&loc, &iatt);
+		ret = glfs_loc_link (fs, &loc, &iatt);
 		if (ret != 0) {
 			goto out;
 		}
 		
 		glfs_iatt_to_stat (fs, &iatt, sb);
 		
-		object = GF_CALLOC (1, sizeof(struct glfs_object), 
-				    glfs_mt_glfs_object_t);
+		object = glfs_h_object_alloc ();
 		if (object == NULL) {
 			errno = ENOMEM;
 			ret = -1;
@@ -489,6 +554,9 @@ glfs_h_mkdir (struct glfs *fs, struct glfs_object *parent, const char *path,
 	}
 
 out:
+	if (inode)
+		inode_unref (inode);
+
 	if (ret && object != NULL) {
 		glfs_h_close (object);
 		object = NULL;
@@ -510,6 +578,7 @@ glfs_h_mknod (struct glfs *fs, struct glfs_object *parent, const char *path,
 {
 	int                 ret = -1;
 	xlator_t           *subvol = NULL;
+	inode_t            *inode = NULL;
 	loc_t               loc = {0, };
 	struct iatt         iatt = {0, };
 	uuid_t              gfid;
@@ -543,6 +612,16 @@ glfs_h_mknod (struct glfs *fs, struct glfs_object *parent, const char *path,
 		goto out;
 	}
 
+	/* get the inode of the object on the active graph */
+	if (parent != NULL) {
+		inode = glfs_resolve_inode (fs, subvol, parent);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
+	}
+
 retry:
 	if (object != NULL) {
 		/* retry madness */
@@ -550,12 +629,6 @@ retry:
 		object = NULL;
 	}
 
-	/* TODO: Should this be done on the retry as well? */
-	/* validate object inodes that are in args */
-	if (parent != NULL) {
-		glfs_validate_inode (fs, parent);
-	}
-
 	object = glfs_h_lookupat (fs, parent, path, sb);
 
 	if (object == NULL && errno != ENOENT)
@@ -569,14 +642,14 @@ retry:
 	}
 
 	/* FIXME: on a retry loop we may leak an inode? */
-	loc.inode = inode_new (parent->inode->table);
+	loc.inode = inode_new (inode->table);
 	if (!loc.inode) {
 		ret = -1;
 		errno = ENOMEM;
 		goto out;
 	}
 
-	loc.parent = inode_ref (parent->inode);
+	loc.parent = inode_ref (inode);
 	loc.name = path;
 	ret = glfs_loc_touchup (&loc);
 	if (ret != 0) {
@@ -586,12 +659,14 @@ retry:
 
 	ret = syncop_mknod (subvol, &loc, mode, dev, xattr_req, &iatt);
 
+	glfs_loc_invalidate (fs, &loc);
+
 	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 
 	if (ret == 0) {
 		/* FIXME: any errors beyond this point may leave the object 
 		 * created but the handle not returned */
-		ret = glfs_loc_link (&loc, &iatt);
+		ret = glfs_loc_link (fs, &loc, &iatt);
 		if (ret != 0) {
 			goto out;
 		}
@@ -599,8 +674,7 @@ retry:
 		/* populate stat */
 		glfs_iatt_to_stat (fs, &iatt, sb);
 
-		object = GF_CALLOC (1, sizeof(struct glfs_object), 
-				    glfs_mt_glfs_object_t);
+		object = glfs_h_object_alloc ();
 		if (object == NULL) {
 			errno = ENOMEM;
 			ret = -1;
@@ -615,6 +689,9 @@ retry:
 		loc.inode = NULL;
 	}
 out:
+	if (inode)
+		inode_unref (inode);
+
 	/* FIXME: If syncop_creat retruns an error, then there seems to be 2 
 	 * inode ref decrements, one in the close below and the other in the 
 	 * fd_destroy, which does not seem to be an issue in glfs_creat, check
@@ -640,6 +717,7 @@ glfs_h_unlink (struct glfs *fs, struct glfs_object *parent, const char *path)
 {
 	int                 ret = -1;
 	xlator_t           *subvol = NULL;
+	inode_t            *inode = NULL;
 	loc_t               loc = {0, };
 	struct stat         sb;
 	struct glfs_object *object = NULL;
@@ -654,27 +732,31 @@ glfs_h_unlink (struct glfs *fs, struct glfs_object *parent, const char *path)
 		goto out;
 	}
 
-	/* validate object inodes that are in args */
+	/* get the inode of the object on the active graph */
 	if (parent != NULL) {
-		glfs_validate_inode (fs, parent);
+		inode = glfs_resolve_inode (fs, subvol, parent);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
-	loc.parent = inode_ref (parent->inode);
+	loc.parent = inode_ref (inode);
 	loc.name = path;
 
-	object = GF_CALLOC (1, sizeof(struct glfs_object), 
-			    glfs_mt_glfs_object_t);
+	object = glfs_h_object_alloc ();
 	if (NULL == object) {
 		errno = ENOMEM;
 		ret = -1;
 		goto out;
 	}
 
-	object->inode = inode_grep (parent->inode->table, parent->inode, path);
+	object->inode = inode_grep (inode->table, inode, path);
 	if (NULL == object->inode) {
 		gf_log (subvol->name, GF_LOG_WARNING, 
 		       "%s:%d: inode grep failed : parent: %p, path : %s, errno = %d", 
-			__FUNCTION__, __LINE__, parent->inode, path, errno);
+			__FUNCTION__, __LINE__, inode, path, errno);
 
 		object = glfs_h_lookupat (fs, parent, path, &sb);
 		if (NULL == object) {
@@ -682,7 +764,7 @@ glfs_h_unlink (struct glfs *fs, struct glfs_object *parent, const char *path)
 			gf_log (subvol->name, GF_LOG_ERROR, 
 				"%s:%d: Failed to lookup inode for parent inode:\
 				%p, path : %s, errno = %d",__FUNCTION__, 
-				__LINE__, parent->inode, path, errno);
+				__LINE__, inode, path, errno);
 
 			goto out;
 		}
@@ -698,21 +780,25 @@ glfs_h_unlink (struct glfs *fs, struct glfs_object *parent, const char *path)
 
 	if (!IA_ISDIR(loc.inode->ia_type)) {
 		ret = syncop_unlink (subvol, &loc);
+		glfs_loc_invalidate (fs, &loc);
 		if (ret != 0) {
 			gf_log (subvol->name, GF_LOG_ERROR,
 				"%s:%d: syncop_unlink error, parent inode: \
 					%p, path : %s, errno = %d",
-				__FUNCTION__, __LINE__, parent->inode, path, 
+				__FUNCTION__, __LINE__, inode, path, 
 				errno);
 			goto out;
 		}
 	} else {
 		ret = syncop_rmdir (subvol, &loc);
+		glfs_loc_invalidate (fs, &loc);
+		if (ret == 0)
+			glfs_dircache_flush (fs);
 		if (ret != 0) {
 			gf_log (subvol->name, GF_LOG_ERROR, 
 				"%s:%d: syncop_rmdir error, parent inode: \
 				%p, path : %s, errno = %d", __FUNCTION__, 
-				__LINE__, parent->inode, path, errno);
+				__LINE__, inode, path, errno);
 			goto out;
 		}
 	}
@@ -721,6 +807,9 @@ glfs_h_unlink (struct glfs *fs, struct glfs_object *parent, const char *path)
 		ret = glfs_loc_unlink (&loc);
 
 out:
+	if (inode)
+		inode_unref (inode);
+
 	loc_wipe (&loc);
 
 	if (object != NULL)
@@ -737,6 +826,7 @@ glfs_h_opendir (struct glfs *fs, struct glfs_object *object)
 	int              ret = -1;
 	struct glfs_fd  *glfd = NULL;
 	xlator_t        *subvol = NULL;
+	inode_t         *inode = NULL;
 	loc_t            loc = {0, };
 	int              reval = 0;
 
@@ -755,14 +845,20 @@ glfs_h_opendir (struct glfs *fs, struct glfs_object *object)
 		goto out;
 
 	INIT_LIST_HEAD (&glfd->entries);
-retry:
-	/* TODO: Should this be done on the retry as well? */
-	/* validate object inodes that are in args */
+	INIT_LIST_HEAD (&glfd->prev_entries);
+
+	/* get the inode of the object on the active graph */
 	if (object != NULL) {
-		glfs_validate_inode (fs, object);
+		inode = glfs_resolve_inode (fs, subvol, object);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
-	if (!IA_ISDIR (object->inode->ia_type)) {
+retry:
+	if (!IA_ISDIR (inode->ia_type)) {
 		ret = -1;
 		errno = ENOTDIR;
 		goto out;
@@ -776,14 +872,14 @@ retry:
 		glfd->fd = NULL;
 	}
 
-	glfd->fd = fd_create (object->inode, getpid());
+	glfd->fd = fd_create (inode, getpid());
 	if (!glfd->fd) {
 		ret = -1;
 		errno = ENOMEM;
 		goto out;
 	}
 
-	loc.inode = inode_ref (object->inode);
+	loc.inode = inode_ref (inode);
 	ret = glfs_loc_touchup (&loc);
 	if (ret != 0) {
 		errno = EINVAL;
@@ -794,6 +890,9 @@ retry:
 
 	ESTALE_RETRY (ret, errno, reval, &loc, retry);
 out:
+	if (inode)
+		inode_unref (inode);
+
 	loc_wipe (&loc);
 
 	if (ret && glfd) {
@@ -882,9 +981,10 @@ glfs_h_create_from_gfid (struct glfs *fs, struct glfs_gfid *id, struct stat *sb)
 	}
 	
 	newinode = inode_link (loc.inode, 0, 0, &iatt);
-	if (newinode)
+	if (newinode) {
 		inode_lookup (newinode);
-	else {
+		glfs_inode_track (fs, newinode);
+	} else {
 		gf_log (subvol->name, GF_LOG_WARNING,
 			"inode linking of %s failed: %s",
 			uuid_utoa (loc.gfid), strerror (errno));
@@ -895,8 +995,7 @@ glfs_h_create_from_gfid (struct glfs *fs, struct glfs_gfid *id, struct stat *sb)
 	/* populate stat */
 	glfs_iatt_to_stat (fs, &iatt, sb);
 
-	object = GF_CALLOC (1, sizeof(struct glfs_object), 
-			    glfs_mt_glfs_object_t);
+	object = glfs_h_object_alloc ();
 	if (object == NULL) {
 		errno = ENOMEM;
 		ret = -1;
@@ -921,6 +1020,7 @@ glfs_h_close (struct glfs_object *object)
 {
 	/* Release the held reference */
 	inode_unref (object->inode);
+	LOCK_DESTROY (&object->lock);
 	GF_FREE (object);
 
 	return 0;
@@ -932,6 +1032,7 @@ glfs_h_truncate (struct glfs *fs, struct glfs_object *object, int offset)
 	loc_t               loc = {0, };
 	int                 ret = -1;
 	xlator_t           *subvol = NULL;
+	inode_t            *inode = NULL;
 
 	if ((object == NULL) || (fs == NULL) || (offset <= 0)) {
 		return -1;
@@ -947,13 +1048,18 @@ glfs_h_truncate (struct glfs *fs, struct glfs_object *object, int offset)
 		goto out;
 	}
 
-	/* validate object inodes that are in args */
-	if (object) {
-		glfs_validate_inode (fs, object);
+	/* get the inode of the object on the active graph */
+	if (object != NULL) {
+		inode = glfs_resolve_inode (fs, subvol, object);
+		if (!inode) {
+			ret = -1;
+			errno = ESTALE;
+			goto out;
+		}
 	}
 
-	loc.inode = inode_ref (object->inode);
-	uuid_copy (loc.gfid, object->inode->gfid);
+	loc.inode = inode_ref (inode);
+	uuid_copy (loc.gfid, inode->gfid);
 	ret = glfs_loc_touchup (&loc);
 	if (ret != 0) {
 		errno = EINVAL;
@@ -961,6 +1067,7 @@ glfs_h_truncate (struct glfs *fs, struct glfs_object *object, int offset)
 	}
 
 	ret = syncop_truncate (subvol, &loc, (off_t)offset);
+	glfs_iatt_cache_invalidate (fs, loc.inode);
 	if ( ret ) {
 		gf_log (subvol->name, GF_LOG_ERROR,
 			"syncop truncate failed : %s, %d, %s", 
@@ -972,6 +1079,9 @@ glfs_h_truncate (struct glfs *fs, struct glfs_object *object, int offset)
 		ret = glfs_loc_unlink (&loc);
 
 out:
+	if (inode)
+		inode_unref (inode);
+
 	loc_wipe (&loc);
 
 	if (object != NULL)
@@ -32,14 +32,52 @@ struct glfs;
 
 typedef int (*glfs_init_cbk) (struct glfs *fs, int ret);
 
+/* Ctx of a glfs_t gone from a glfs_ctx, whose master may still get
+   events from the shared poller */
+struct glfs_ctx_left {
+	struct glfs_ctx_left *next;
+	glusterfs_ctx_t      *ctx;
+};
+
+/* Template ctx whose pools, event pool and syncenv are handed to every
+   glfs_t created with glfs_new_from_ctx()
+*/
+struct glfs_ctx {
+	glusterfs_ctx_t    *ctx;
+	pthread_mutex_t     mutex;
+	pthread_t           poller;
+	int                 poller_running;
+	int                 users; /* glfs_t on it not freed yet, under
+				      @mutex */
+	struct glfs_ctx_left *left; /* freed by glfs_ctx_fini(), under
+				       @mutex */
+};
+
+/* Private of the master xlator, left around by glfs_fini() for as long
+   as events may reach the master. Event paths get @fs through
+   glfs_master_get(), glfs_fini() waits for their glfs_master_put().
+*/
+struct glfs_master_priv {
+	pthread_mutex_t     mutex;
+	pthread_cond_t      cond;
+	struct glfs        *fs; /* NULL once glfs_fini() is done with it */
+	int                 refs; /* of @fs, by glfs_master_get() */
+	uint64_t            purged; /* tracked inodes destroyed */
+};
+
 struct glfs {
 	char               *volname;
 
 	glusterfs_ctx_t    *ctx;
 
 	pthread_t           poller;
+	int                 poller_running; /* @poller, not with @shared */
+	struct glfs_ctx    *shared; /* threads and pools, NULL if own */
+
+	struct glfs_master_priv *master_priv; /* of @ctx->master */
 
 	glfs_init_cbk       init_cbk;
+	int                 init_cbk_pending; /* for glfs_master_put() */
 	pthread_mutex_t     mutex;
 	pthread_cond_t      cond;
 	int                 init;
@@ -52,6 +90,9 @@ struct glfs {
 
 	char               *oldvolfile;
 	ssize_t             oldvollen;
+	glusterfs_graph_t  *oldvolgraph; /* @oldvolfile parsed, not activated,
+					    for topology comparisons */
+	char               *volfile_cache; /* directory, NULL if disabled */
 
 	inode_t            *cwd;
 
@@ -60,25 +101,128 @@ struct glfs {
 	struct list_head    openfds;
 
 	gf_boolean_t        migration_in_progress;
+
+	uint32_t            attr_timeout; /* msecs, 0 disables caching of
+					     lookup results */
+	uint32_t            negative_timeout; /* msecs, 0 disables caching
+						 of ENOENT lookups */
+
+	gf_lock_t           dircache_lock;
+	struct glfs_dircache_entry *dircache; /* GLFS_DIRCACHE_SIZE slots */
+
+	uint32_t            ra_pages; /* read-ahead window, 0 disables */
+	size_t              ra_page_size;
+	uint64_t            inode_gen; /* last glfs_inode_ctx @gen handed out */
+
+	size_t              readdir_size; /* bytes asked per readdir(p) */
+
+	uint32_t            inode_lru_limit; /* of new inode tables */
+
+	struct list_head    migrate_fds; /* glfds left on an older graph */
+	int                 migrate_workers; /* threads draining
+					       @migrate_fds, under @mutex */
+
+	int                 bg_frames; /* of glfs_bg_frame_new(), waited
+					  for by glfs_fini() */
+
+	int                 fini; /* glfs_fini() in progress, under @mutex */
+	int                 fini_down; /* CHILD_DOWN seen since @fini */
+};
+
+struct glfs_ra;
+struct glfs_wb;
+struct glfs_rda;
+
+/* Open addressed d_off -> entry table of a batch of directory entries */
+struct glfs_dirindex {
+	gf_dirent_t      **slots;
+	int                bits; /* log2 of the number of slots */
 };
 
 struct glfs_fd {
 	struct list_head   openfds;
 	struct glfs       *fs;
 	off_t              offset;
-	fd_t              *fd; /* Currently guared by @fs->mutex. TODO: per-glfd lock */
+	gf_lock_t          lock;
+	fd_t              *fd; /* Read under @lock or @fs->mutex, replaced
+				  only while holding both */
 	struct list_head   entries;
 	gf_dirent_t       *next;
+	struct glfs_dirindex index; /* of @entries */
+	struct list_head   prev_entries; /* batch read before @entries, or
+					    after it if @prev_follows */
+	struct glfs_dirindex prev_index;
+	int                prev_follows;
+	struct glfs_ra    *ra; /* set up on the first read, under @lock */
+	struct glfs_wb    *wb; /* write-behind, NULL unless enabled */
+	struct glfs_rda   *rda; /* next batch of @entries */
+	struct list_head   migrate; /* in @fs->migrate_fds, under @fs->mutex */
+	xlator_t          *held_subvol; /* graph of @fd kept up until the
+					   migration, under @fs->mutex */
+	int                migrating; /* under @fs->mutex */
 };
 
+#define GLFS_RA_MAX_PAGES 64
+#define GLFS_WB_MIN_SIZE  4096
+
+#define GLFS_READDIR_SIZE 131072
+#define GLFS_READDIR_MIN_SIZE 4096
+
+#define GLFS_INODE_LRU_LIMIT 131072
+
+#define GLFS_MIGRATE_WORKERS 4
+
+#define GLFS_FINI_TIMEOUT 10 /* secs, for fops and bricks to go away */
+
 /* glfs handle/object introduced for the alternate gfapi implementation based 
    on glfs handles/gfid/inode - requirement from nfs-ganesha 
 */
 struct glfs_object {
+        gf_lock_t       lock; /* replacing @inode after a graph switch */
         inode_t         *inode;
         uuid_t          gfid;
 };
 
+/* Per inode context of the master xlator, freed in its forget() */
+struct glfs_inode_ctx {
+	struct iatt        iatt;
+	struct timeval     iatt_expire;
+	uint64_t           gen; /* changed on every local modification,
+				   unique across inodes */
+	struct list_head   neg_dentries; /* names known not to exist in
+					    this directory, newest first */
+	int                neg_count;
+};
+
+#define GLFS_NEG_DENTRY_MAX 64 /* per directory */
+
+#define GLFS_DIRCACHE_SIZE 1024 /* slots, direct mapped */
+
+/* Maps an absolute directory path, as given by the application, to the
+   inode it resolved to, so that resolving a name within it does not
+   walk the components again.
+*/
+struct glfs_dircache_entry {
+	char              *path;
+	size_t             len;
+	inode_t           *inode;
+};
+
+struct glfs_neg_dentry {
+	struct list_head   list;
+	struct timeval     expire;
+	char               name[];
+};
+
+/* A reference to data held in iobufs, handed out to the application by the
+   zero-copy calls. @iov points into the iobufs pinned by @iobref.
+*/
+struct glfs_buf {
+	struct iovec      *iov;
+	int                count;
+	struct iobref     *iobref;
+};
+
 #define DEFAULT_EVENT_POOL_SIZE           16384
 #define GF_MEMPOOL_COUNT_OF_DICT_T        4096
 #define GF_MEMPOOL_COUNT_OF_DATA_T        (GF_MEMPOOL_COUNT_OF_DICT_T * 4)
@@ -93,7 +237,9 @@ int glfs_lresolve (struct glfs *fs, xlator_t *subvol, const char *path, loc_t *l
 		   struct iatt *iatt, int reval);
 fd_t *glfs_resolve_fd (struct glfs *fs, xlator_t *subvol, struct glfs_fd *glfd);
 
-fd_t *__glfs_migrate_fd (struct glfs *fs, xlator_t *subvol, struct glfs_fd *glfd);
+fd_t *__glfs_migrate_fd (struct glfs *fs, xlator_t *subvol, struct glfs_fd *glfd,
+			 xlator_t **held);
+void __glfs_fd_set (struct glfs_fd *glfd, fd_t *fd);
 
 int glfs_first_lookup (xlator_t *subvol);
 
@@ -107,7 +253,9 @@ __glfs_entry_fs (struct glfs *fs)
 static inline void
 __glfs_entry_fd (struct glfs_fd *fd)
 {
-	THIS = fd->fd->inode->table->xl->ctx->master;
+	/* Not through @fd->fd, which can be replaced by a
+	   concurrent migration */
+	THIS = fd->fs->ctx->master;
 }
 
 
@@ -149,17 +297,25 @@ void glfs_fd_bind (struct glfs_fd *glfd);
 
 xlator_t * glfs_active_subvol (struct glfs *fs);
 xlator_t * __glfs_active_subvol (struct glfs *fs);
+call_frame_t *glfs_bg_frame_new (struct glfs *fs);
+void glfs_bg_frame_destroy (struct glfs *fs, call_frame_t *frame);
+struct glfs *glfs_master_get (xlator_t *master);
+void glfs_master_put (struct glfs *fs);
 void glfs_subvol_done (struct glfs *fs, xlator_t *subvol);
+xlator_t * glfs_subvol_hold (xlator_t *subvol);
+gf_boolean_t glfs_subvol_tryhold (xlator_t *subvol);
 
 inode_t * glfs_refresh_inode (xlator_t *subvol, inode_t *inode);
 
 inode_t *glfs_cwd_get (struct glfs *fs);
 int glfs_cwd_set (struct glfs *fs, inode_t *inode);
-void glfs_validate_inode (struct glfs *fs, struct glfs_object *object);
+inode_t *glfs_resolve_inode (struct glfs *fs, xlator_t *subvol,
+			     struct glfs_object *object);
 int __glfs_cwd_set (struct glfs *fs, inode_t *inode);
 
 
 int glfs_mgmt_init (struct glfs *fs);
+void glfs_mgmt_fini (struct glfs *fs);
 void glfs_init_done (struct glfs *fs, int ret);
 int glfs_process_volfp (struct glfs *fs, FILE *fp);
 int glfs_resolve (struct glfs *fs, xlator_t *subvol, const char *path, 
@@ -167,6 +323,11 @@ int glfs_resolve (struct glfs *fs, xlator_t *subvol, const char *path,
 int glfs_lresolve (struct glfs *fs, xlator_t *subvol, const char *path, 
 		   loc_t *loc, struct iatt *iatt, int reval);
 fd_t *glfs_resolve_fd (struct glfs *fs, xlator_t *subvol, struct glfs_fd *glfd);
+/* @force_lookup levels of glfs_resolve_component() */
+#define GLFS_LOOKUP_NONE   0 /* an inode in the table is good enough */
+#define GLFS_LOOKUP_FRESH  1 /* attributes wanted, may be served from cache */
+#define GLFS_LOOKUP_FORCE  2 /* always go to the bricks */
+
 inode_t *glfs_resolve_component (struct glfs *fs, xlator_t *subvol,
                                  inode_t *parent, const char *component,
                                  struct iatt *iatt, int force_lookup);
@@ -177,10 +338,27 @@ int glfs_resolve_at (struct glfs *fs, xlator_t *subvol, inode_t *at,
                      int follow, int reval);
 int glfs_loc_touchup (loc_t *loc);
 
+void glfs_iatt_cache_set (struct glfs *fs, inode_t *inode, struct iatt *iatt);
+int glfs_iatt_cache_get (struct glfs *fs, inode_t *inode, struct iatt *iatt);
+void glfs_iatt_cache_invalidate (struct glfs *fs, inode_t *inode);
+uint64_t glfs_inode_gen (struct glfs *fs, inode_t *inode);
+void glfs_inode_track (struct glfs *fs, inode_t *inode);
+void glfs_loc_invalidate (struct glfs *fs, loc_t *loc);
+void glfs_inode_ctx_destroy (struct glfs_inode_ctx *ictx);
+void glfs_dircache_flush (struct glfs *fs);
+
+void glfs_ra_invalidate (struct glfs_fd *glfd);
+void glfs_ra_destroy (struct glfs_fd *glfd);
+
+void glfs_wb_flush (struct glfs_fd *glfd, xlator_t *subvol, fd_t *fd);
+int glfs_wb_sync (struct glfs_fd *glfd, xlator_t *subvol, fd_t *fd);
+void glfs_wb_destroy (struct glfs_fd *glfd);
+void glfs_rda_destroy (struct glfs_fd *glfd);
+
 void glfs_iatt_to_stat (struct glfs *fs, struct iatt *iatt, struct stat *stat);
 void glfs_iatt_from_stat (struct stat *sb, int valid, struct iatt *iatt, 
 			 int *glvalid);
-int glfs_loc_link (loc_t *loc, struct iatt *iatt);
+int glfs_loc_link (struct glfs *fs, loc_t *loc, struct iatt *iatt);
 int glfs_loc_unlink (loc_t *loc);
 inode_t *__glfs_refresh_inode (struct glfs *fs, xlator_t *subvol,
                                inode_t *inode);
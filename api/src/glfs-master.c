@@ -50,7 +50,8 @@ glfs_graph_setup (struct glfs *fs, glusterfs_graph_t *graph)
 		}
 
 		if (!new_subvol->itable) {
-			itable = inode_table_new (131072, new_subvol);
+			itable = inode_table_new (fs->inode_lru_limit,
+						  new_subvol);
 			if (!itable) {
 				errno = ENOMEM;
 				ret = -1;
@@ -62,7 +63,9 @@ glfs_graph_setup (struct glfs *fs, glusterfs_graph_t *graph)
 
 		old_subvol = fs->next_subvol;
 		fs->next_subvol = new_subvol;
-		fs->next_subvol->winds++; /* first ref */
+		/* first ref, @winds is also updated outside @fs->mutex
+		   by glfs_active_subvol() and glfs_subvol_done() */
+		__sync_fetch_and_add (&fs->next_subvol->winds, 1);
 		ret = 0;
 	}
 unlock:
@@ -76,14 +79,29 @@ unlock:
 }
 
 
-int
-notify (xlator_t *this, int event, void *data, ...)
+static int
+glfs_master_notify (xlator_t *this, struct glfs *fs, int event, void *data)
 {
 	glusterfs_graph_t   *graph = NULL;
-	struct glfs	    *fs = NULL;
+	int                  fini = 0;
 
 	graph = data;
-	fs = this->private;
+
+	if (event == GF_EVENT_CHILD_UP || event == GF_EVENT_CHILD_DOWN) {
+		pthread_mutex_lock (&fs->mutex);
+		{
+			fini = fs->fini;
+			if (fini && event == GF_EVENT_CHILD_DOWN) {
+				fs->fini_down = 1;
+				pthread_cond_broadcast (&fs->cond);
+			}
+		}
+		pthread_mutex_unlock (&fs->mutex);
+
+		if (fini)
+			/* no graph switch while tearing down */
+			return 0;
+	}
 
 	switch (event) {
 	case GF_EVENT_GRAPH_NEW:
@@ -111,6 +129,25 @@ notify (xlator_t *this, int event, void *data, ...)
 }
 
 
+int
+notify (xlator_t *this, int event, void *data, ...)
+{
+	struct glfs	    *fs = NULL;
+	int                  ret = 0;
+
+	fs = glfs_master_get (this);
+	if (!fs)
+		/* glfs_fini() is done with it */
+		return 0;
+
+	ret = glfs_master_notify (this, fs, event, data);
+
+	glfs_master_put (fs);
+
+	return ret;
+}
+
+
 int
 mem_acct_init (xlator_t *this)
 {
@@ -138,4 +175,24 @@ struct xlator_dumpops dumpops;
 struct xlator_fops fops;
 
 
-struct xlator_cbks cbks;
+int
+glfs_forget (xlator_t *this, inode_t *inode)
+{
+	uint64_t                 value = 0;
+	struct glfs_master_priv *priv = NULL;
+
+	/* outlives @fs, no need for glfs_master_get() */
+	priv = this->private;
+	__sync_fetch_and_add (&priv->purged, 1);
+
+	inode_ctx_del (inode, this, &value);
+	if (value)
+		glfs_inode_ctx_destroy ((void *)(long) value);
+
+	return 0;
+}
+
+
+struct xlator_cbks cbks = {
+	.forget = glfs_forget,
+};
@@ -24,6 +24,19 @@ enum glfs_mem_types_ {
 	glfs_mt_volfile_t,
 	glfs_mt_xlator_cmdline_option_t,
 	glfs_mt_glfs_object_t,
+	glfs_mt_glfs_buf_t,
+	glfs_mt_glfs_ioq_t,
+	glfs_mt_glfs_inode_ctx_t,
+	glfs_mt_glfs_neg_dentry_t,
+	glfs_mt_glfs_dircache_t,
+	glfs_mt_glfs_ra_t,
+	glfs_mt_glfs_ra_page_t,
+	glfs_mt_glfs_wb_t,
+	glfs_mt_glfs_wb_req_t,
+	glfs_mt_glfs_copy_t,
+	glfs_mt_glfs_rda_t,
+	glfs_mt_glfs_dirindex_t,
+	glfs_mt_glfs_master_priv_t,
 	glfs_mt_end
 
 };
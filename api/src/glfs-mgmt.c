@@ -15,6 +15,8 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
 
 #ifndef _CONFIG_H
 #define _CONFIG_H
@@ -35,6 +37,7 @@
 
 #include "syncop.h"
 #include "xlator.h"
+#include "hashfn.h"
 
 #include "glfs-internal.h"
 #include "glfs-mem-types.h"
@@ -99,10 +102,14 @@ mgmt_cbk_spec (struct rpc_clnt *rpc, void *mydata, void *data)
 	xlator_t    *this = NULL;
 
 	this = mydata;
-	fs = this->private;
+	fs = glfs_master_get (this);
+	if (!fs)
+		return 0;
 
 	glfs_volfile_fetch (fs);
 
+	glfs_master_put (fs);
+
 	return 0;
 }
 
@@ -272,46 +279,73 @@ out:
 }
 
 
+/* Opens the @size bytes of @volfile as a stream for the graph parser,
+   in memory where the platform has fmemopen(). The stream reads @volfile
+   in place, it must be closed before @volfile is freed.
+*/
+static FILE *
+glfs_volfile_open (char *volfile, ssize_t size)
+{
+	FILE *fp = NULL;
+
+#ifndef GF_DARWIN_HOST_OS
+	fp = fmemopen (volfile, size, "r");
+#else
+	fp = tmpfile ();
+	if (!fp)
+		return NULL;
+
+	fwrite (volfile, size, 1, fp);
+	fflush (fp);
+	if (ferror (fp)) {
+		fclose (fp);
+		return NULL;
+	}
+
+	rewind (fp);
+#endif
+
+	return fp;
+}
+
+
 /* Function has 3types of return value 0, -ve , 1
  *   return 0	       =======> reconfiguration of options has succeeded
  *   return 1	       =======> the graph has to be reconstructed and all the xlators should be inited
  *   return -1(or -ve) =======> Some Internal Error occurred during the operation
+ *
+ * The graph parsed from @volfile is handed back in @graphp, to be cached
+ * with glusterfs_oldvolfile_update() if the volfile is taken.
  */
 static int
-glusterfs_volfile_reconfigure (struct glfs *fs, FILE *newvolfile_fp)
+glusterfs_volfile_reconfigure (struct glfs *fs, char *volfile, ssize_t size,
+			       glusterfs_graph_t **graphp)
 {
 	glusterfs_graph_t *oldvolfile_graph = NULL;
 	glusterfs_graph_t *newvolfile_graph = NULL;
-	FILE		  *oldvolfile_fp    = NULL;
+	FILE		  *newvolfile_fp    = NULL;
 	glusterfs_ctx_t	  *ctx		    = NULL;
 
 	int ret = -1;
 
-	oldvolfile_fp = tmpfile ();
-	if (!oldvolfile_fp)
+	newvolfile_fp = glfs_volfile_open (volfile, size);
+	if (!newvolfile_fp)
 		goto out;
 
-	if (!fs->oldvollen) {
-		ret = 1; // Has to call INIT for the whole graph
-		goto out;
-	}
-	fwrite (fs->oldvolfile, fs->oldvollen, 1, oldvolfile_fp);
-	fflush (oldvolfile_fp);
-	if (ferror (oldvolfile_fp)) {
+	newvolfile_graph = glusterfs_graph_construct (newvolfile_fp);
+	fclose (newvolfile_fp);
+	if (!newvolfile_graph) {
 		goto out;
 	}
 
-	oldvolfile_graph = glusterfs_graph_construct (oldvolfile_fp);
-	if (!oldvolfile_graph) {
-		goto out;
-	}
+	*graphp = newvolfile_graph;
 
-	newvolfile_graph = glusterfs_graph_construct (newvolfile_fp);
-	if (!newvolfile_graph) {
+	if (!fs->oldvolgraph) {
+		ret = 1; // Has to call INIT for the whole graph
 		goto out;
 	}
 
-	if (!is_graph_topology_equal (oldvolfile_graph,
+	if (!is_graph_topology_equal (fs->oldvolgraph,
 				      newvolfile_graph)) {
 
 		ret = 1;
@@ -351,18 +385,22 @@ glusterfs_volfile_reconfigure (struct glfs *fs, FILE *newvolfile_fp)
 
 	ret = 0;
 out:
-	if (oldvolfile_fp)
-		fclose (oldvolfile_fp);
-
 	return ret;
 }
 
 
+/* Remembers @volfile as the current one, along with its parsed @graph
+   which is consumed */
 static int
-glusterfs_oldvolfile_update (struct glfs *fs, char *volfile, ssize_t size)
+glusterfs_oldvolfile_update (struct glfs *fs, char *volfile, ssize_t size,
+			     glusterfs_graph_t *graph)
 {
 	int ret = -1;
 
+	if (fs->oldvolgraph)
+		glusterfs_graph_destroy (fs->oldvolgraph);
+	fs->oldvolgraph = graph;
+
 	fs->oldvollen = size;
 	if (!fs->oldvolfile) {
 		fs->oldvolfile = GF_CALLOC (1, size+1, glfs_mt_volfile_t);
@@ -372,6 +410,11 @@ glusterfs_oldvolfile_update (struct glfs *fs, char *volfile, ssize_t size)
 
 	if (!fs->oldvolfile) {
 		fs->oldvollen = 0;
+		/* no volfile to compare it with */
+		if (fs->oldvolgraph) {
+			glusterfs_graph_destroy (fs->oldvolgraph);
+			fs->oldvolgraph = NULL;
+		}
 	} else {
 		memcpy (fs->oldvolfile, volfile, size);
 		fs->oldvollen = size;
@@ -382,6 +425,201 @@ glusterfs_oldvolfile_update (struct glfs *fs, char *volfile, ssize_t size)
 }
 
 
+/* Makes @volfile the current volfile, reconfiguring the active graph
+   or switching to a new one */
+static int
+glfs_volfile_apply (struct glfs *fs, char *volfile, ssize_t size)
+{
+	FILE              *volfp = NULL;
+	glusterfs_graph_t *volgraph = NULL;
+	int                ret = -1;
+
+	/*  Check if only options have changed. No need to reload the
+	*  volfile if topology hasn't changed.
+	*  glusterfs_volfile_reconfigure returns 3 possible return states
+	*  return 0	     =======> reconfiguration of options has succeeded
+	*  return 1	     =======> the graph has to be reconstructed and all the xlators should be inited
+	*  return -1(or -ve) =======> Some Internal Error occurred during the operation
+	*/
+
+	ret = glusterfs_volfile_reconfigure (fs, volfile, size, &volgraph);
+	if (ret == 0) {
+		gf_log ("glusterfsd-mgmt", GF_LOG_DEBUG,
+			"No need to re-load volfile, reconfigure done");
+		ret = glusterfs_oldvolfile_update (fs, volfile, size,
+						   volgraph);
+		volgraph = NULL;
+		goto out;
+	}
+
+	if (ret < 0) {
+		gf_log ("glusterfsd-mgmt", GF_LOG_DEBUG,
+			"Reconfigure failed !!");
+		goto out;
+	}
+
+	volfp = glfs_volfile_open (volfile, size);
+	if (!volfp) {
+		ret = -1;
+		goto out;
+	}
+
+	ret = glfs_process_volfp (fs, volfp);
+	/* volfp closed */
+	volfp = NULL;
+	if (ret)
+		goto out;
+
+	ret = glusterfs_oldvolfile_update (fs, volfile, size, volgraph);
+	volgraph = NULL;
+out:
+	if (volgraph)
+		glusterfs_graph_destroy (volgraph);
+
+	return ret;
+}
+
+
+/* The volfile cache keeps the last volfile fetched for a volume in
+   <dir>/<server>:<volfile-id>.vol, behind a header line carrying its
+   size and checksum. A truncated or corrupted file is ignored.
+*/
+#define GLFS_VOLFILE_CACHE_MAGIC "# glfs volfile cache"
+
+static int
+glfs_volfile_cache_path (struct glfs *fs, char *path, size_t len)
+{
+	cmd_args_t *cmd_args = NULL;
+	char       *trav = NULL;
+	int         ret = -1;
+
+	cmd_args = &fs->ctx->cmd_args;
+
+	ret = snprintf (path, len, "%s/", fs->volfile_cache);
+	if (ret < 0 || (size_t) ret >= len)
+		return -1;
+
+	/* the server may be a socket path, and the volfile id name a
+	   sub-volume as in "vol/snap" */
+	trav = path + ret;
+
+	ret = snprintf (trav, len - ret, "%s:%s.vol", cmd_args->volfile_server,
+			cmd_args->volfile_id);
+	if (ret < 0 || (size_t) ret >= len - (trav - path))
+		return -1;
+
+	for (; *trav; trav++) {
+		if (*trav == '/')
+			*trav = '_';
+	}
+
+	return 0;
+}
+
+
+static void
+glfs_volfile_cache_store (struct glfs *fs, char *volfile, ssize_t size)
+{
+	char         path[PATH_MAX];
+	char         tmppath[PATH_MAX];
+	FILE        *fp = NULL;
+	int          fd = -1;
+
+	if (glfs_volfile_cache_path (fs, path, sizeof (path)))
+		return;
+
+	snprintf (tmppath, sizeof (tmppath), "%s.XXXXXX", path);
+
+	/* written aside and renamed over, readers never see it partial */
+	fd = mkstemp (tmppath);
+	if (fd == -1)
+		goto err;
+
+	fp = fdopen (fd, "w");
+	if (!fp) {
+		close (fd);
+		goto err;
+	}
+
+	fprintf (fp, "%s %zd %08x\n", GLFS_VOLFILE_CACHE_MAGIC, size,
+		 gf_dm_hashfn (volfile, size));
+	fwrite (volfile, size, 1, fp);
+
+	if (ferror (fp) || fclose (fp) != 0) {
+		fp = NULL;
+		goto err;
+	}
+	fp = NULL;
+
+	if (rename (tmppath, path) == -1)
+		goto err;
+
+	return;
+err:
+	gf_log ("glfs-mgmt", GF_LOG_WARNING,
+		"could not cache volume file in %s (%s)", path,
+		strerror (errno));
+
+	if (fp)
+		fclose (fp);
+	unlink (tmppath);
+}
+
+
+/* Builds the graph from the cached volfile, if any, before glusterd is
+   reached. The fetch which follows only switches graphs if the volfile
+   changed meanwhile.
+*/
+static void
+glfs_volfile_cache_load (struct glfs *fs)
+{
+	char         path[PATH_MAX];
+	FILE        *fp = NULL;
+	char        *volfile = NULL;
+	ssize_t      size = 0;
+	unsigned int cksum = 0;
+	int          ret = -1;
+
+	if (glfs_volfile_cache_path (fs, path, sizeof (path)))
+		return;
+
+	fp = fopen (path, "r");
+	if (!fp)
+		/* nothing cached yet */
+		return;
+
+	if (fscanf (fp, GLFS_VOLFILE_CACHE_MAGIC " %zd %x", &size,
+		    &cksum) != 2 ||
+	    fgetc (fp) != '\n' || size <= 0)
+		goto out;
+
+	volfile = GF_CALLOC (1, size + 1, glfs_mt_volfile_t);
+	if (!volfile)
+		goto out;
+
+	if (fread (volfile, size, 1, fp) != 1 ||
+	    gf_dm_hashfn (volfile, size) != cksum)
+		goto out;
+
+	fclose (fp);
+	fp = NULL;
+
+	ret = glfs_volfile_apply (fs, volfile, size);
+	if (ret == 0)
+		gf_log ("glfs-mgmt", GF_LOG_INFO,
+			"using cached volume file %s", path);
+out:
+	if (ret)
+		gf_log ("glfs-mgmt", GF_LOG_INFO,
+			"ignoring cached volume file %s", path);
+
+	if (fp)
+		fclose (fp);
+
+	GF_FREE (volfile);
+}
+
+
 int
 mgmt_getspec_cbk (struct rpc_req *req, struct iovec *iov, int count,
 		  void *myframe)
@@ -391,13 +629,17 @@ mgmt_getspec_cbk (struct rpc_req *req, struct iovec *iov, int count,
 	glusterfs_ctx_t		*ctx = NULL;
 	int			 ret   = 0;
 	ssize_t			 size = 0;
-	FILE			*tmpfp = NULL;
 	int                      need_retry = 0;
 	struct glfs		*fs = NULL;
 
 	frame = myframe;
 	ctx = frame->this->ctx;
-	fs = ((xlator_t *)ctx->master)->private;
+	fs = glfs_master_get (ctx->master);
+	if (!fs) {
+		/* glfs_fini() is done with it */
+		STACK_DESTROY (frame->root);
+		return 0;
+	}
 
 	if (-1 == req->rpc_status) {
 		ret = -1;
@@ -430,48 +672,12 @@ mgmt_getspec_cbk (struct rpc_req *req, struct iovec *iov, int count,
 		goto out;
 	}
 
-	tmpfp = tmpfile ();
-	if (!tmpfp) {
-		ret = -1;
-		goto out;
-	}
-
-	fwrite (rsp.spec, size, 1, tmpfp);
-	fflush (tmpfp);
-	if (ferror (tmpfp)) {
-		ret = -1;
-		goto out;
-	}
-
-	/*  Check if only options have changed. No need to reload the
-	*  volfile if topology hasn't changed.
-	*  glusterfs_volfile_reconfigure returns 3 possible return states
-	*  return 0	     =======> reconfiguration of options has succeeded
-	*  return 1	     =======> the graph has to be reconstructed and all the xlators should be inited
-	*  return -1(or -ve) =======> Some Internal Error occurred during the operation
-	*/
-
-	ret = glusterfs_volfile_reconfigure (fs, tmpfp);
-	if (ret == 0) {
-		gf_log ("glusterfsd-mgmt", GF_LOG_DEBUG,
-			"No need to re-load volfile, reconfigure done");
-		ret = glusterfs_oldvolfile_update (fs, rsp.spec, size);
-		goto out;
-	}
-
-	if (ret < 0) {
-		gf_log ("glusterfsd-mgmt", GF_LOG_DEBUG,
-			"Reconfigure failed !!");
-		goto out;
-	}
-
-	ret = glfs_process_volfp (fs, tmpfp);
-	/* tmpfp closed */
-	tmpfp = NULL;
+	ret = glfs_volfile_apply (fs, rsp.spec, size);
 	if (ret)
 		goto out;
 
-	ret = glusterfs_oldvolfile_update (fs, rsp.spec, size);
+	if (fs->volfile_cache)
+		glfs_volfile_cache_store (fs, rsp.spec, size);
 out:
 	STACK_DESTROY (frame->root);
 
@@ -500,8 +706,7 @@ out:
                 }
 	}
 
-	if (tmpfp)
-		fclose (tmpfp);
+	glfs_master_put (fs);
 
 	return 0;
 }
@@ -575,9 +780,13 @@ mgmt_rpc_notify (struct rpc_clnt *rpc, void *mydata, rpc_clnt_event_t event,
 
 	this = mydata;
 	ctx = this->ctx;
-	fs = ((xlator_t *)ctx->master)->private;
+	fs = glfs_master_get (ctx->master);
 	cmd_args = &ctx->cmd_args;
 
+	if (!fs)
+		/* glfs_fini() is done with it */
+		return 0;
+
 	switch (event) {
 	case RPC_CLNT_DISCONNECT:
 		if (!ctx->active) {
@@ -613,6 +822,8 @@ mgmt_rpc_notify (struct rpc_clnt *rpc, void *mydata, rpc_clnt_event_t event,
 		break;
 	}
 
+	glfs_master_put (fs);
+
 	return 0;
 }
 
@@ -652,6 +863,9 @@ glfs_mgmt_init (struct glfs *fs)
 	if (ctx->mgmt)
 		return 0;
 
+	if (fs->volfile_cache)
+		glfs_volfile_cache_load (fs);
+
 	if (cmd_args->volfile_server_port)
 		port = cmd_args->volfile_server_port;
 
@@ -696,3 +910,19 @@ out:
 	return ret;
 }
 
+
+void
+glfs_mgmt_fini (struct glfs *fs)
+{
+	glusterfs_ctx_t		*ctx = NULL;
+
+	ctx = fs->ctx;
+
+	if (!ctx->mgmt)
+		return;
+
+	/* no reconnects nor volfile fetches past this point, pending
+	   requests are unwound with an error */
+	rpc_clnt_disable (ctx->mgmt);
+	ctx->mgmt = NULL;
+}
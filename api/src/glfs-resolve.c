@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <sys/time.h>
 
 #ifndef _CONFIG_H
 #define _CONFIG_H
@@ -27,6 +28,7 @@
 #include "event.h"
 #include "glfs-mem-types.h"
 #include "common-utils.h"
+#include "hashfn.h"
 #include "syncop.h"
 #include "call-stub.h"
 
@@ -73,7 +75,8 @@ __glfs_first_lookup (struct glfs *fs, xlator_t *subvol)
 
 
 inode_t *
-glfs_refresh_inode_safe (xlator_t *subvol, inode_t *oldinode)
+glfs_refresh_inode_safe (struct glfs *fs, xlator_t *subvol,
+			 inode_t *oldinode)
 {
 	loc_t        loc = {0, };
 	int          ret = -1;
@@ -107,8 +110,10 @@ glfs_refresh_inode_safe (xlator_t *subvol, inode_t *oldinode)
 	}
 
 	newinode = inode_link (loc.inode, 0, 0, &iatt);
-	if (newinode)
+	if (newinode) {
 		inode_lookup (newinode);
+		glfs_inode_track (fs, newinode);
+	}
 
 	loc_wipe (&loc);
 
@@ -124,7 +129,7 @@ __glfs_refresh_inode (struct glfs *fs, xlator_t *subvol, inode_t *inode)
 	fs->migration_in_progress = 1;
 	pthread_mutex_unlock (&fs->mutex);
 	{
-		newinode = glfs_refresh_inode_safe (subvol, inode);
+		newinode = glfs_refresh_inode_safe (fs, subvol, inode);
 	}
 	pthread_mutex_lock (&fs->mutex);
 	fs->migration_in_progress = 0;
@@ -162,6 +167,332 @@ out:
 }
 
 
+static struct glfs_inode_ctx *
+__glfs_inode_ctx_get (struct glfs *fs, inode_t *inode, gf_boolean_t create)
+{
+	struct glfs_inode_ctx *ictx = NULL;
+	uint64_t               value = 0;
+	int                    ret = -1;
+
+	/* 0 is set by glfs_inode_track() */
+	ret = __inode_ctx_get (inode, fs->ctx->master, &value);
+	if (ret == 0 && value)
+		return (struct glfs_inode_ctx *)(long) value;
+
+	if (!create)
+		return NULL;
+
+	ictx = GF_CALLOC (1, sizeof (*ictx), glfs_mt_glfs_inode_ctx_t);
+	if (!ictx)
+		return NULL;
+
+	INIT_LIST_HEAD (&ictx->neg_dentries);
+	ictx->gen = __sync_add_and_fetch (&fs->inode_gen, 1);
+
+	value = (uint64_t)(long) ictx;
+	ret = __inode_ctx_set (inode, fs->ctx->master, &value);
+	if (ret) {
+		GF_FREE (ictx);
+		return NULL;
+	}
+
+	return ictx;
+}
+
+
+void
+glfs_inode_ctx_destroy (struct glfs_inode_ctx *ictx)
+{
+	struct glfs_neg_dentry *neg = NULL;
+	struct glfs_neg_dentry *tmp = NULL;
+
+	list_for_each_entry_safe (neg, tmp, &ictx->neg_dentries, list) {
+		list_del (&neg->list);
+		GF_FREE (neg);
+	}
+
+	GF_FREE (ictx);
+}
+
+
+static void
+glfs_expiry_set (struct timeval *expire, uint32_t msecs)
+{
+	gettimeofday (expire, NULL);
+
+	expire->tv_sec += msecs / 1000;
+	expire->tv_usec += (msecs % 1000) * 1000;
+	if (expire->tv_usec >= 1000000) {
+		expire->tv_sec++;
+		expire->tv_usec -= 1000000;
+	}
+}
+
+
+void
+glfs_iatt_cache_set (struct glfs *fs, inode_t *inode, struct iatt *iatt)
+{
+	struct glfs_inode_ctx *ictx = NULL;
+	struct timeval         expire = {0, };
+	uint32_t               timeout = 0;
+
+	timeout = fs->attr_timeout;
+	if (!timeout || !inode || !iatt)
+		return;
+
+	glfs_expiry_set (&expire, timeout);
+
+	LOCK (&inode->lock);
+	{
+		ictx = __glfs_inode_ctx_get (fs, inode, _gf_true);
+		if (ictx) {
+			ictx->iatt = *iatt;
+			ictx->iatt_expire = expire;
+		}
+	}
+	UNLOCK (&inode->lock);
+}
+
+
+/* Returns 0 and fills @iatt if @inode has unexpired cached attributes */
+int
+glfs_iatt_cache_get (struct glfs *fs, inode_t *inode, struct iatt *iatt)
+{
+	struct glfs_inode_ctx *ictx = NULL;
+	struct timeval         now = {0, };
+	int                    ret = -1;
+
+	if (!fs->attr_timeout)
+		return -1;
+
+	gettimeofday (&now, NULL);
+
+	LOCK (&inode->lock);
+	{
+		ictx = __glfs_inode_ctx_get (fs, inode, _gf_false);
+		if (ictx && timercmp (&now, &ictx->iatt_expire, <)) {
+			if (iatt)
+				*iatt = ictx->iatt;
+			ret = 0;
+		}
+	}
+	UNLOCK (&inode->lock);
+
+	return ret;
+}
+
+
+/* To be called on every local modification of @inode */
+void
+glfs_iatt_cache_invalidate (struct glfs *fs, inode_t *inode)
+{
+	struct glfs_inode_ctx *ictx = NULL;
+
+	if (!inode)
+		return;
+
+	LOCK (&inode->lock);
+	{
+		ictx = __glfs_inode_ctx_get (fs, inode, _gf_false);
+		if (ictx) {
+			timerclear (&ictx->iatt_expire);
+			ictx->gen = __sync_add_and_fetch (&fs->inode_gen, 1);
+		}
+	}
+	UNLOCK (&inode->lock);
+}
+
+
+/* Makes the master's forget() see @inode when it is destroyed, to be
+   counted in the master's @purged, without allocating anything for it
+*/
+void
+glfs_inode_track (struct glfs *fs, inode_t *inode)
+{
+	uint64_t  value = 0;
+
+	if (!inode)
+		return;
+
+	LOCK (&inode->lock);
+	{
+		if (__inode_ctx_get (inode, fs->ctx->master, &value) != 0)
+			__inode_ctx_set (inode, fs->ctx->master, &value);
+	}
+	UNLOCK (&inode->lock);
+}
+
+
+/* Data cached from @inode is valid as long as this stays the same. A
+   value is never reused, not even by another inode, so no reference on
+   @inode needs to be kept along with it.
+*/
+uint64_t
+glfs_inode_gen (struct glfs *fs, inode_t *inode)
+{
+	struct glfs_inode_ctx *ictx = NULL;
+	uint64_t               gen = 0;
+
+	LOCK (&inode->lock);
+	{
+		ictx = __glfs_inode_ctx_get (fs, inode, _gf_true);
+		if (ictx)
+			gen = ictx->gen;
+	}
+	UNLOCK (&inode->lock);
+
+	return gen;
+}
+
+
+/* Remembers that @name does not exist in @parent */
+static void
+glfs_neg_dentry_add (struct glfs *fs, inode_t *parent, const char *name)
+{
+	struct glfs_inode_ctx  *ictx = NULL;
+	struct glfs_neg_dentry *neg = NULL;
+	struct glfs_neg_dentry *tmp = NULL;
+	struct timeval          expire = {0, };
+	uint32_t                timeout = 0;
+	size_t                  len = 0;
+
+	timeout = fs->negative_timeout;
+	if (!timeout || !parent || !name)
+		return;
+
+	len = strlen (name);
+	neg = GF_CALLOC (1, sizeof (*neg) + len + 1,
+			 glfs_mt_glfs_neg_dentry_t);
+	if (!neg)
+		return;
+
+	memcpy (neg->name, name, len + 1);
+	INIT_LIST_HEAD (&neg->list);
+	glfs_expiry_set (&neg->expire, timeout);
+
+	LOCK (&parent->lock);
+	{
+		ictx = __glfs_inode_ctx_get (fs, parent, _gf_true);
+		if (!ictx) {
+			GF_FREE (neg);
+			neg = NULL;
+			goto unlock;
+		}
+
+		list_for_each_entry (tmp, &ictx->neg_dentries, list) {
+			if (strcmp (tmp->name, name) == 0) {
+				/* refresh the existing entry */
+				tmp->expire = neg->expire;
+				list_move (&tmp->list, &ictx->neg_dentries);
+				GF_FREE (neg);
+				neg = NULL;
+				goto unlock;
+			}
+		}
+
+		list_add (&neg->list, &ictx->neg_dentries);
+		neg = NULL;
+
+		if (++ictx->neg_count > GLFS_NEG_DENTRY_MAX) {
+			/* evict the oldest */
+			neg = list_entry (ictx->neg_dentries.prev,
+					  struct glfs_neg_dentry, list);
+			list_del (&neg->list);
+			ictx->neg_count--;
+		}
+	}
+unlock:
+	UNLOCK (&parent->lock);
+
+	GF_FREE (neg);
+}
+
+
+/* Returns 0 if @name is known not to exist in @parent */
+static int
+glfs_neg_dentry_get (struct glfs *fs, inode_t *parent, const char *name)
+{
+	struct glfs_inode_ctx  *ictx = NULL;
+	struct glfs_neg_dentry *neg = NULL;
+	struct glfs_neg_dentry *tmp = NULL;
+	struct timeval          now = {0, };
+	int                     ret = -1;
+
+	if (!fs->negative_timeout)
+		return -1;
+
+	gettimeofday (&now, NULL);
+
+	LOCK (&parent->lock);
+	{
+		ictx = __glfs_inode_ctx_get (fs, parent, _gf_false);
+		if (!ictx)
+			goto unlock;
+
+		list_for_each_entry_safe (neg, tmp, &ictx->neg_dentries,
+					  list) {
+			if (strcmp (neg->name, name) != 0)
+				continue;
+
+			if (timercmp (&now, &neg->expire, <)) {
+				ret = 0;
+			} else {
+				list_del (&neg->list);
+				ictx->neg_count--;
+				GF_FREE (neg);
+			}
+			break;
+		}
+	}
+unlock:
+	UNLOCK (&parent->lock);
+
+	return ret;
+}
+
+
+static void
+glfs_neg_dentry_invalidate (struct glfs *fs, inode_t *parent,
+			    const char *name)
+{
+	struct glfs_inode_ctx  *ictx = NULL;
+	struct glfs_neg_dentry *neg = NULL;
+	struct glfs_neg_dentry *tmp = NULL;
+
+	if (!parent || !name)
+		return;
+
+	LOCK (&parent->lock);
+	{
+		ictx = __glfs_inode_ctx_get (fs, parent, _gf_false);
+		if (!ictx)
+			goto unlock;
+
+		list_for_each_entry_safe (neg, tmp, &ictx->neg_dentries,
+					  list) {
+			if (strcmp (neg->name, name) == 0) {
+				list_del (&neg->list);
+				ictx->neg_count--;
+				GF_FREE (neg);
+				break;
+			}
+		}
+	}
+unlock:
+	UNLOCK (&parent->lock);
+}
+
+
+/* To be called after a namespace or attribute change on @loc */
+void
+glfs_loc_invalidate (struct glfs *fs, loc_t *loc)
+{
+	glfs_iatt_cache_invalidate (fs, loc->parent);
+	glfs_iatt_cache_invalidate (fs, loc->inode);
+	glfs_neg_dentry_invalidate (fs, loc->parent, loc->name);
+}
+
+
 int
 glfs_resolve_symlink (struct glfs *fs, xlator_t *subvol, inode_t *inode,
 		      char **lpath)
@@ -199,6 +530,9 @@ glfs_resolve_base (struct glfs *fs, xlator_t *subvol, inode_t *inode,
 	int         ret = -1;
 	char       *path = NULL;
 
+	if (glfs_iatt_cache_get (fs, inode, iatt) == 0)
+		return;
+
 	loc.inode = inode_ref (inode);
 	uuid_copy (loc.gfid, inode->gfid);
 
@@ -208,6 +542,8 @@ glfs_resolve_base (struct glfs *fs, xlator_t *subvol, inode_t *inode,
 		goto out;
 
 	ret = syncop_lookup (subvol, &loc, NULL, iatt, NULL, NULL);
+	if (ret == 0)
+		glfs_iatt_cache_set (fs, inode, iatt);
 out:
 	loc_wipe (&loc);
 }
@@ -233,9 +569,10 @@ glfs_resolve_component (struct glfs *fs, xlator_t *subvol, inode_t *parent,
 	uuid_copy (loc.pargfid, parent->gfid);
 
 
-	if (strcmp (component, ".") == 0)
+	if (component[0] == '.' && component[1] == '\0')
 		loc.inode = inode_ref (parent);
-	else if (strcmp (component, "..") == 0)
+	else if (component[0] == '.' && component[1] == '.' &&
+		 component[2] == '\0')
 		loc.inode = inode_parent (parent, 0, 0);
 	else
 		loc.inode = inode_grep (parent->table, parent, component);
@@ -244,12 +581,24 @@ glfs_resolve_component (struct glfs *fs, xlator_t *subvol, inode_t *parent,
 		uuid_copy (loc.gfid, loc.inode->gfid);
 		reval = 1;
 
-		if (!force_lookup) {
+		if (force_lookup == GLFS_LOOKUP_NONE) {
 			inode = inode_ref (loc.inode);
 			ciatt.ia_type = inode->ia_type;
 			goto found;
 		}
+
+		if (force_lookup == GLFS_LOOKUP_FRESH &&
+		    glfs_iatt_cache_get (fs, loc.inode, &ciatt) == 0) {
+			inode = inode_ref (loc.inode);
+			goto found;
+		}
 	} else {
+		if (force_lookup != GLFS_LOOKUP_FORCE &&
+		    glfs_neg_dentry_get (fs, parent, component) == 0) {
+			errno = ENOENT;
+			goto out;
+		}
+
 		uuid_generate (gfid);
 		loc.inode = inode_new (parent->table);
 	}
@@ -289,10 +638,19 @@ glfs_resolve_component (struct glfs *fs, xlator_t *subvol, inode_t *parent,
 		ret = syncop_lookup (subvol, &loc, xattr_req, &ciatt,
 				     NULL, NULL);
 	}
-	if (ret)
+	if (ret) {
+		if (errno == ENOENT) {
+			glfs_neg_dentry_add (fs, parent, component);
+			errno = ENOENT;
+		}
 		goto out;
+	}
 
 	inode = inode_link (loc.inode, loc.parent, component, &ciatt);
+	if (inode) {
+		glfs_inode_track (fs, inode);
+		glfs_iatt_cache_set (fs, inode, &ciatt);
+	}
 found:
 	if (inode)
 		inode_lookup (inode);
@@ -308,6 +666,137 @@ out:
 }
 
 
+static inode_t *
+glfs_dircache_get (struct glfs *fs, xlator_t *subvol, const char *path,
+		   size_t len)
+{
+	struct glfs_dircache_entry *entry = NULL;
+	inode_t                    *inode = NULL;
+
+	if (!fs->dircache)
+		return NULL;
+
+	entry = &fs->dircache[SuperFastHash (path, len) % GLFS_DIRCACHE_SIZE];
+
+	LOCK (&fs->dircache_lock);
+	{
+		if (entry->inode && entry->len == len &&
+		    entry->inode->table == subvol->itable &&
+		    memcmp (entry->path, path, len) == 0)
+			inode = inode_ref (entry->inode);
+	}
+	UNLOCK (&fs->dircache_lock);
+
+	return inode;
+}
+
+
+static void
+glfs_dircache_set (struct glfs *fs, const char *path, size_t len,
+		   inode_t *inode)
+{
+	struct glfs_dircache_entry *entry = NULL;
+	char                       *newpath = NULL;
+	char                       *oldpath = NULL;
+	inode_t                    *oldinode = NULL;
+
+	if (!fs->dircache)
+		return;
+
+	newpath = GF_MALLOC (len + 1, gf_common_mt_char);
+	if (!newpath)
+		return;
+	memcpy (newpath, path, len);
+	newpath[len] = '\0';
+
+	entry = &fs->dircache[SuperFastHash (path, len) % GLFS_DIRCACHE_SIZE];
+
+	LOCK (&fs->dircache_lock);
+	{
+		oldpath = entry->path;
+		oldinode = entry->inode;
+
+		entry->path = newpath;
+		entry->len = len;
+		entry->inode = inode_ref (inode);
+	}
+	UNLOCK (&fs->dircache_lock);
+
+	GF_FREE (oldpath);
+	if (oldinode)
+		inode_unref (oldinode);
+}
+
+
+/* Drops every cached prefix. To be called when directories move or go
+   away, and when the graph switches.
+*/
+void
+glfs_dircache_flush (struct glfs *fs)
+{
+	struct glfs_dircache_entry *entry = NULL;
+	int                         i = 0;
+
+	if (!fs->dircache)
+		return;
+
+	LOCK (&fs->dircache_lock);
+	{
+		for (i = 0; i < GLFS_DIRCACHE_SIZE; i++) {
+			entry = &fs->dircache[i];
+			if (!entry->inode)
+				continue;
+
+			inode_unref (entry->inode);
+			GF_FREE (entry->path);
+			entry->inode = NULL;
+			entry->path = NULL;
+			entry->len = 0;
+		}
+	}
+	UNLOCK (&fs->dircache_lock);
+}
+
+
+/* Returns the length of the directory part of @path, without trailing
+   slashes, or 0 if the last component sits right under the root.
+*/
+static size_t
+glfs_path_dirlen (const char *path)
+{
+	size_t len = 0;
+
+	len = strlen (path);
+
+	while (len && path[len - 1] == '/')
+		len--;
+	while (len && path[len - 1] != '/')
+		len--;
+	while (len && path[len - 1] == '/')
+		len--;
+
+	return len;
+}
+
+
+/* Returns the start of the component following @path, skipping any
+   slashes, and its length in @len. NULL when there are no more.
+*/
+static const char *
+glfs_path_next (const char *path, size_t *len)
+{
+	while (*path == '/')
+		path++;
+
+	if (*path == '\0')
+		return NULL;
+
+	*len = strcspn (path, "/");
+
+	return path;
+}
+
+
 int
 glfs_resolve_at (struct glfs *fs, xlator_t *subvol, inode_t *at,
 		 const char *origpath, loc_t *loc, struct iatt *iatt,
@@ -315,35 +804,63 @@ glfs_resolve_at (struct glfs *fs, xlator_t *subvol, inode_t *at,
 {
 	inode_t    *inode = NULL;
 	inode_t    *parent = NULL;
-	char       *saveptr = NULL;
-	char       *path = NULL;
-	char       *component = NULL;
-	char       *next_component = NULL;
+	const char *next_component = NULL;
+	const char *cur = NULL;
+	size_t      len = 0;
+	size_t      next_len = 0;
+	size_t      dirlen = 0;
+	char        component[NAME_MAX + 1];
 	int         ret = -1;
+	int         symlinked = 0;
 	struct iatt ciatt = {0, };
 
-	path = gf_strdup (origpath);
-	if (!path) {
-		errno = ENOMEM;
-		return -1;
-	}
+	component[0] = '\0';
+
+	cur = origpath;
 
 	parent = NULL;
-	if (at && path[0] != '/') {
+	if (at && origpath[0] != '/') {
 		/* A relative resolution of a path which starts with '/'
 		   is equal to an absolute path resolution.
 		*/
 		inode = inode_ref (at);
 	} else {
-		inode = inode_ref (subvol->itable->root);
-
-		glfs_resolve_base (fs, subvol, inode, &ciatt);
+		dirlen = glfs_path_dirlen (origpath);
+		if (dirlen && !reval)
+			inode = glfs_dircache_get (fs, subvol, origpath,
+						   dirlen);
+
+		if (inode) {
+			/* only the last component is left to resolve */
+			cur = origpath + dirlen;
+			ciatt.ia_type = IA_IFDIR;
+			dirlen = 0;
+		} else {
+			inode = inode_ref (subvol->itable->root);
+
+			glfs_resolve_base (fs, subvol, inode, &ciatt);
+		}
 	}
 
-	for (component = strtok_r (path, "/", &saveptr);
-	     component; component = next_component) {
+	/* Components are walked in place, each one copied to @component
+	   only to get it NUL terminated for the inode table.
+	*/
+	for (cur = glfs_path_next (cur, &len); cur;
+	     cur = next_component, len = next_len) {
 
-		next_component = strtok_r (NULL, "/", &saveptr);
+		next_component = glfs_path_next (cur + len, &next_len);
+
+		if (len > NAME_MAX) {
+			if (inode)
+				inode_unref (inode);
+			inode = NULL;
+			errno = ENAMETOOLONG;
+			ret = -1;
+			goto out;
+		}
+
+		memcpy (component, cur, len);
+		component[len] = '\0';
 
 		if (parent)
 			inode_unref (parent);
@@ -354,9 +871,14 @@ glfs_resolve_at (struct glfs *fs, xlator_t *subvol, inode_t *at,
 						component, &ciatt,
 						/* force hard lookup on the last
 						   component, as the caller
-						   wants proper iatt filled
+						   wants proper iatt filled,
+						   unless the cached one is
+						   still fresh
 						*/
-						(reval || !next_component));
+						reval ? GLFS_LOOKUP_FORCE :
+						(next_component ?
+						 GLFS_LOOKUP_NONE :
+						 GLFS_LOOKUP_FRESH));
 		if (!inode)
 			break;
 
@@ -368,6 +890,9 @@ glfs_resolve_at (struct glfs *fs, xlator_t *subvol, inode_t *at,
 			char *lpath = NULL;
 			loc_t sym_loc = {0,};
 
+			if (next_component)
+				symlinked = 1;
+
 			if (follow > GLFS_SYMLINK_MAX_FOLLOW) {
 				errno = ELOOP;
 				ret = -1;
@@ -424,6 +949,12 @@ glfs_resolve_at (struct glfs *fs, xlator_t *subvol, inode_t *at,
 	   might have failed (@inode) if at all.
 	*/
 
+	/* remember the directory, unless symlinks were followed to get
+	   there as they can be retargeted behind our back
+	*/
+	if (parent && dirlen && !symlinked)
+		glfs_dircache_set (fs, origpath, dirlen, parent);
+
 	loc->parent = parent;
 	if (parent) {
 		uuid_copy (loc->pargfid, parent->gfid);
@@ -440,7 +971,8 @@ glfs_resolve_at (struct glfs *fs, xlator_t *subvol, inode_t *at,
 
 	glfs_loc_touchup (loc);
 out:
-	GF_FREE (path);
+	if (ret && !loc->parent && parent)
+		inode_unref (parent);
 
 	/* do NOT loc_wipe here as only last component might be missing */
 
@@ -542,8 +1074,10 @@ out:
 }
 
 
+/* @held: the old graph is kept up until this migration is done */
 fd_t *
-glfs_migrate_fd_safe (struct glfs *fs, xlator_t *newsubvol, fd_t *oldfd)
+glfs_migrate_fd_safe (struct glfs *fs, xlator_t *newsubvol, fd_t *oldfd,
+		      gf_boolean_t held)
 {
 	fd_t *newfd = NULL;
 	inode_t *oldinode = NULL;
@@ -560,7 +1094,7 @@ glfs_migrate_fd_safe (struct glfs *fs, xlator_t *newsubvol, fd_t *oldfd)
 	if (oldsubvol == newsubvol)
 		return fd_ref (oldfd);
 
-	if (!oldsubvol->switched) {
+	if (held || !oldsubvol->switched) {
 		ret = syncop_fsync (oldsubvol, oldfd, 0);
 		if (ret) {
 			gf_log (fs->volname, GF_LOG_WARNING,
@@ -571,7 +1105,7 @@ glfs_migrate_fd_safe (struct glfs *fs, xlator_t *newsubvol, fd_t *oldfd)
 		}
 	}
 
-	newinode = glfs_refresh_inode_safe (newsubvol, oldinode);
+	newinode = glfs_refresh_inode_safe (fs, newsubvol, oldinode);
 	if (!newinode) {
 		gf_log (fs->volname, GF_LOG_WARNING,
 			"inode (%s) refresh failed (%s) on graph %s (%d)",
@@ -647,67 +1181,195 @@ out:
 }
 
 
+/* Replace @glfd->fd with @fd, consuming the caller's ref on @fd.
+   Must be called with @fs->mutex held.
+*/
+void
+__glfs_fd_set (struct glfs_fd *glfd, fd_t *fd)
+{
+	fd_t *oldfd = NULL;
+
+	LOCK (&glfd->lock);
+	{
+		oldfd = glfd->fd;
+		glfd->fd = fd;
+	}
+	UNLOCK (&glfd->lock);
+
+	if (oldfd)
+		fd_unref (oldfd);
+}
+
+
+/* Moves @glfd over to @newsubvol and returns a ref on the fd to use
+   there, or NULL. @fs->mutex is given up meanwhile; unlike inode
+   refreshes this does not set @migration_in_progress, only fops on
+   @glfd itself wait for the migration to complete.
+
+   The ref @glfd held on its old graph is handed back in @held, to be
+   dropped with glfs_subvol_done() once @fs->mutex is released.
+*/
 fd_t *
-__glfs_migrate_fd (struct glfs *fs, xlator_t *newsubvol, struct glfs_fd *glfd)
+__glfs_migrate_fd (struct glfs *fs, xlator_t *newsubvol, struct glfs_fd *glfd,
+		   xlator_t **held)
 {
 	fd_t *oldfd = NULL;
 	fd_t *newfd = NULL;
 
-	oldfd = glfd->fd;
+	while (glfd->migrating)
+		pthread_cond_wait (&fs->cond, &fs->mutex);
+
+	if (glfd->fd->inode->table->xl == newsubvol) {
+		/* done by the migration we waited for, or before @glfd
+		   got queued; off the queue either way, the worker would
+		   spin on it otherwise */
+		if (newsubvol == fs->active_subvol) {
+			list_del_init (&glfd->migrate);
+			*held = glfd->held_subvol;
+			glfd->held_subvol = NULL;
+		}
+		return fd_ref (glfd->fd);
+	}
+
+	glfd->migrating = 1;
+	list_del_init (&glfd->migrate);
+
+	/* @fs->mutex is given up below, hold on to the fd
+	   while it is being migrated */
+	oldfd = fd_ref (glfd->fd);
 
-	fs->migration_in_progress = 1;
 	pthread_mutex_unlock (&fs->mutex);
 	{
-		newfd = glfs_migrate_fd_safe (fs, newsubvol, oldfd);
+		newfd = glfs_migrate_fd_safe (fs, newsubvol, oldfd,
+					      (glfd->held_subvol != NULL));
 	}
 	pthread_mutex_lock (&fs->mutex);
-	fs->migration_in_progress = 0;
+
+	fd_unref (oldfd);
+
+	if (newsubvol == fs->active_subvol) {
+		if (newfd)
+			__glfs_fd_set (glfd, fd_ref (newfd));
+
+		/* the old graph is not kept up for a second attempt */
+		*held = glfd->held_subvol;
+		glfd->held_subvol = NULL;
+	} else if (glfd->held_subvol && list_empty (&glfd->migrate)) {
+		/* graph switched meanwhile, @newfd is only good for the
+		   caller, move @glfd again later */
+		list_add_tail (&glfd->migrate, &fs->migrate_fds);
+	}
+
+	glfd->migrating = 0;
+	pthread_cond_broadcast (&fs->cond);
 
 	return newfd;
 }
 
 
 fd_t *
-__glfs_resolve_fd (struct glfs *fs, xlator_t *subvol, struct glfs_fd *glfd)
+__glfs_resolve_fd (struct glfs *fs, xlator_t *subvol, struct glfs_fd *glfd,
+		   xlator_t **held)
 {
-	fd_t *fd = NULL;
-
 	if (glfd->fd->inode->table->xl == subvol)
 		return fd_ref (glfd->fd);
 
-	fd = __glfs_migrate_fd (fs, subvol, glfd);
-	if (!fd)
-		return NULL;
-
-	if (subvol == fs->active_subvol) {
-		fd_unref (glfd->fd);
-		glfd->fd = fd_ref (fd);
-	}
-
-	return fd;
+	return __glfs_migrate_fd (fs, subvol, glfd, held);
 }
 
 
 fd_t *
 glfs_resolve_fd (struct glfs *fs, xlator_t *subvol, struct glfs_fd *glfd)
 {
-	fd_t *fd = NULL;
+	fd_t     *fd = NULL;
+	xlator_t *held = NULL;
+
+	/* Fast path: @glfd->fd is already on @subvol, which is the case
+	   for every fop not racing with a graph switch. Only the glfd
+	   lock is needed to take a ref on it, @fs->mutex is not touched.
+	*/
+	LOCK (&glfd->lock);
+	{
+		if (glfd->fd->inode->table->xl == subvol)
+			fd = fd_ref (glfd->fd);
+	}
+	UNLOCK (&glfd->lock);
+
+	if (fd)
+		return fd;
 
 	glfs_lock (fs);
 	{
-		fd = __glfs_resolve_fd (fs, subvol, glfd);
+		fd = __glfs_resolve_fd (fs, subvol, glfd, &held);
 	}
 	glfs_unlock (fs);
 
+	glfs_subvol_done (fs, held);
+
 	return fd;
 }
 
 
+/* Background migration of the glfds queued on @fs->migrate_fds, for
+   those not used again soon after a graph switch. A plain thread and
+   not a synctask, as it waits on @fs->cond like any application thread.
+*/
+static void *
+glfs_migrate_worker (void *opaque)
+{
+	struct glfs    *fs = NULL;
+	struct glfs_fd *glfd = NULL;
+	xlator_t       *subvol = NULL;
+	xlator_t       *held = NULL;
+	fd_t           *fd = NULL;
+
+	fs = opaque;
+
+	do {
+		glfd = NULL;
+		subvol = NULL;
+		held = NULL;
+		fd = NULL;
+
+		glfs_lock (fs);
+		{
+			if (!list_empty (&fs->migrate_fds)) {
+				glfd = list_entry (fs->migrate_fds.next,
+						   struct glfs_fd, migrate);
+				subvol = glfs_subvol_hold (fs->active_subvol);
+				fd = __glfs_migrate_fd (fs, subvol, glfd,
+							&held);
+			} else {
+				/* in the same section as the check, so that
+				   a switch queueing more spawns a worker */
+				fs->migrate_workers--;
+				pthread_cond_broadcast (&fs->cond);
+			}
+		}
+		glfs_unlock (fs);
+
+		if (fd)
+			fd_unref (fd);
+
+		glfs_subvol_done (fs, held);
+		glfs_subvol_done (fs, subvol);
+	} while (glfd);
+
+	return NULL;
+}
+
+
+/* Queues the glfds still on an older graph for migration to @subvol.
+   Each keeps its graph up until it is migrated, on its next use or by
+   one of the background workers, so a graph switch does not wait on
+   the open fds.
+*/
 void
 __glfs_migrate_openfds (struct glfs *fs, xlator_t *subvol)
 {
 	struct glfs_fd *glfd = NULL;
-	fd_t *fd = NULL;
+	pthread_t       worker;
+	int             count = 0;
 
 	list_for_each_entry (glfd, &fs->openfds, openfds) {
 		if (uuid_is_null (glfd->fd->inode->gfid)) {
@@ -719,11 +1381,30 @@ __glfs_migrate_openfds (struct glfs *fs, xlator_t *subvol)
 			continue;
 		}
 
-		fd = __glfs_migrate_fd (fs, subvol, glfd);
-		if (fd) {
-			fd_unref (glfd->fd);
-			glfd->fd = fd;
-		}
+		/* still queued from an earlier switch, or being moved */
+		if (!list_empty (&glfd->migrate) || glfd->migrating)
+			continue;
+
+		if (glfd->fd->inode->table->xl == subvol)
+			continue;
+
+		/* the fd may be left on a graph older than the one being
+		   replaced, after a failed migration, and that one may be
+		   down already: it is not revived, only migrated */
+		if (glfs_subvol_tryhold (glfd->fd->inode->table->xl))
+			glfd->held_subvol = glfd->fd->inode->table->xl;
+		list_add_tail (&glfd->migrate, &fs->migrate_fds);
+		count++;
+	}
+
+	/* workers still running from an earlier switch keep going */
+	while (count && fs->migrate_workers < GLFS_MIGRATE_WORKERS) {
+		if (pthread_create (&worker, NULL, glfs_migrate_worker, fs))
+			/* the rest is migrated on first use */
+			break;
+		pthread_detach (worker);
+		fs->migrate_workers++;
+		count--;
 	}
 }
 
@@ -772,6 +1453,9 @@ __glfs_active_subvol (struct glfs *fs)
 	fs->active_subvol = fs->next_subvol;
 	fs->next_subvol = NULL;
 
+	/* cached directories belong to the old inode table */
+	glfs_dircache_flush (fs);
+
 	if (new_cwd) {
 		__glfs_cwd_set (fs, new_cwd);
 		inode_unref (new_cwd);
@@ -783,18 +1467,43 @@ __glfs_active_subvol (struct glfs *fs)
 	return new_subvol;
 }
 
+static inline gf_boolean_t
+glfs_graph_switch_pending (struct glfs *fs)
+{
+	return (fs->next_subvol || fs->old_subvol ||
+		fs->migration_in_progress);
+}
+
+
 xlator_t *
 glfs_active_subvol (struct glfs *fs)
 {
 	xlator_t      *subvol = NULL;
 	xlator_t      *old_subvol = NULL;
 
+	/* Lock-free fast path when no graph switch is pending. A whole
+	   switch may complete between reading @active_subvol and taking
+	   the ref, so the ref is only taken while @winds is non-zero,
+	   i.e. while PARENT_DOWN has not been sent yet. @subvol is then
+	   checked to still be active. If it is not, the ref is handed
+	   back, which may legitimately be the graph's last one.
+	*/
+	subvol = fs->active_subvol;
+	if (subvol && !glfs_graph_switch_pending (fs) &&
+	    glfs_subvol_tryhold (subvol)) {
+		if (subvol == fs->active_subvol &&
+		    !glfs_graph_switch_pending (fs))
+			return subvol;
+
+		glfs_subvol_done (fs, subvol);
+	}
+
 	glfs_lock (fs);
 	{
 		subvol = __glfs_active_subvol (fs);
 
 		if (subvol)
-			subvol->winds++;
+			__sync_fetch_and_add (&subvol->winds, 1);
 
 		if (fs->old_subvol) {
 			old_subvol = fs->old_subvol;
@@ -811,6 +1520,39 @@ glfs_active_subvol (struct glfs *fs)
 }
 
 
+/* Take an additional ref on a @subvol already held by the caller,
+   to be released with glfs_subvol_done().
+*/
+xlator_t *
+glfs_subvol_hold (xlator_t *subvol)
+{
+	__sync_fetch_and_add (&subvol->winds, 1);
+
+	return subvol;
+}
+
+
+/* Take a ref on @subvol unless its @winds already dropped to zero,
+   in which case PARENT_DOWN was sent and the graph must not be
+   revived.
+*/
+gf_boolean_t
+glfs_subvol_tryhold (xlator_t *subvol)
+{
+	int  winds = 0;
+
+	winds = subvol->winds;
+	while (winds > 0) {
+		if (__sync_bool_compare_and_swap (&subvol->winds, winds,
+						  winds + 1))
+			return _gf_true;
+		winds = subvol->winds;
+	}
+
+	return _gf_false;
+}
+
+
 void
 glfs_subvol_done (struct glfs *fs, xlator_t *subvol)
 {
@@ -820,12 +1562,8 @@ glfs_subvol_done (struct glfs *fs, xlator_t *subvol)
 	if (!subvol)
 		return;
 
-	glfs_lock (fs);
-	{
-		ref = (--subvol->winds);
-		active_subvol = fs->active_subvol;
-	}
-	glfs_unlock (fs);
+	ref = __sync_sub_and_fetch (&subvol->winds, 1);
+	active_subvol = fs->active_subvol;
 
 	if (ref == 0) {
 		assert (subvol != active_subvol);
@@ -901,31 +1639,65 @@ glfs_cwd_get (struct glfs *fs)
 	return cwd;
 }
 
-/* This function is to validate an inode in case there is a graph switch post
-   handing out the inode, and as a result we need to refresh the same. Any 
-   handle based gf API that gets an inode as an in parameter, needs to validate 
-   the inode (which would also refresh the same) using this function before 
-   using the inode for any further operation 
+/* Returns a ref on the inode of @object on @subvol. Any handle based gf
+   API that gets an object as an in parameter must use the inode returned
+   here, as a graph switch after handing out the object leaves its inode in
+   the old graph's table.
+
+   Objects are moved to the active graph lazily, on first use after the
+   switch. The graph of the object's inode tells whether it is current, so
+   the common case is a compare under the object's own lock. The lookup on
+   the new graph is done without @fs->mutex, and the old inode is released
+   once the object points to the new one.
 */
-void 
-glfs_validate_inode (struct glfs *fs, struct glfs_object *object)
+inode_t *
+glfs_resolve_inode (struct glfs *fs, xlator_t *subvol,
+		    struct glfs_object *object)
 {
-	inode_t *updated = NULL;
+	inode_t      *oldinode = NULL;
+	inode_t      *inode = NULL;
+	gf_boolean_t  moved = _gf_false;
+	char          uuid1[64];
 
-	/* TODO: Check if we can upgrade this lock to a R/W with writer 
-	   promotion for faster common case.
-	*/
-	glfs_lock (fs);
+	LOCK (&object->lock);
+	{
+		if (object->inode->table->xl == subvol)
+			inode = inode_ref (object->inode);
+		else
+			oldinode = inode_ref (object->inode);
+	}
+	UNLOCK (&object->lock);
 
-	if (object->inode->table->xl != fs->active_subvol) {
-		/* TODO: Unref the old inode handle? 
-		*/
-		updated = __glfs_refresh_inode (fs, fs->active_subvol, 
-						object->inode);
-		object->inode = updated;
+	if (inode)
+		return inode;
+
+	inode = glfs_refresh_inode_safe (fs, subvol, oldinode);
+	if (!inode) {
+		gf_log (fs->volname, GF_LOG_WARNING,
+			"inode (%s) refresh failed (%s) on graph %s (%d)",
+			uuid_utoa_r (oldinode->gfid, uuid1), strerror (errno),
+			graphid_str (subvol), subvol->graph->id);
+		goto out;
 	}
 
-	glfs_unlock (fs);
+	if (subvol != fs->active_subvol)
+		/* graph switched meanwhile, leave @object alone */
+		goto out;
+
+	LOCK (&object->lock);
+	{
+		if (object->inode == oldinode) {
+			object->inode = inode_ref (inode);
+			moved = _gf_true;
+		}
+	}
+	UNLOCK (&object->lock);
 
-	return;
+	if (moved)
+		/* the ref @object held */
+		inode_unref (oldinode);
+out:
+	inode_unref (oldinode);
+
+	return inode;
 }
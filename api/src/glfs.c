@@ -21,7 +21,6 @@
   - handle umask (per filesystem?)
   - make itables LRU based
   - implement glfs_fini()
-  - 0-copy for readv/writev
   - reconcile the open/creat mess
 */
 
@@ -47,6 +46,7 @@
 #include "common-utils.h"
 #include "syncop.h"
 #include "call-stub.h"
+#include "globals.h"
 
 #include "glfs.h"
 #include "glfs-internal.h"
@@ -62,8 +62,11 @@ vol_assigned (cmd_args_t *args)
 }
 
 
+/* With @shared, the buffer and memory pools, event pool and syncenv of
+   its ctx are used instead of new ones
+*/
 static int
-glusterfs_ctx_defaults_init (glusterfs_ctx_t *ctx)
+glusterfs_ctx_defaults_init (glusterfs_ctx_t *ctx, struct glfs_ctx *shared)
 {
 	call_pool_t   *pool = NULL;
 	int	       ret = -1;
@@ -77,21 +80,6 @@ glusterfs_ctx_defaults_init (glusterfs_ctx_t *ctx)
 
 	ctx->page_size	= 128 * GF_UNIT_KB;
 
-	ctx->iobuf_pool = iobuf_pool_new ();
-	if (!ctx->iobuf_pool) {
-		goto err;
-	}
-
-	ctx->event_pool = event_pool_new (DEFAULT_EVENT_POOL_SIZE);
-	if (!ctx->event_pool) {
-		goto err;
-	}
-
-	ctx->env = syncenv_new (0, 0, 0);
-	if (!ctx->env) {
-		goto err;
-	}
-
 	pool = GF_CALLOC (1, sizeof (call_pool_t),
 			  glfs_mt_call_pool_t);
 	if (!pool) {
@@ -109,6 +97,33 @@ glusterfs_ctx_defaults_init (glusterfs_ctx_t *ctx)
 		goto err;
 	}
 
+	if (shared) {
+		/* @pool stays per ctx, glfs_fini() waits on its frames */
+		ctx->iobuf_pool = shared->ctx->iobuf_pool;
+		ctx->event_pool = shared->ctx->event_pool;
+		ctx->env = shared->ctx->env;
+		ctx->stub_mem_pool = shared->ctx->stub_mem_pool;
+		ctx->dict_pool = shared->ctx->dict_pool;
+		ctx->dict_pair_pool = shared->ctx->dict_pair_pool;
+		ctx->dict_data_pool = shared->ctx->dict_data_pool;
+		goto done;
+	}
+
+	ctx->iobuf_pool = iobuf_pool_new ();
+	if (!ctx->iobuf_pool) {
+		goto err;
+	}
+
+	ctx->event_pool = event_pool_new (DEFAULT_EVENT_POOL_SIZE);
+	if (!ctx->event_pool) {
+		goto err;
+	}
+
+	ctx->env = syncenv_new (0, 0, 0);
+	if (!ctx->env) {
+		goto err;
+	}
+
 	ctx->stub_mem_pool = mem_pool_new (call_stub_t, 1024);
 	if (!ctx->stub_mem_pool) {
 		goto err;
@@ -126,7 +141,7 @@ glusterfs_ctx_defaults_init (glusterfs_ctx_t *ctx)
 	ctx->dict_data_pool = mem_pool_new (data_t, GF_MEMPOOL_COUNT_OF_DATA_T);
 	if (!ctx->dict_data_pool)
 		goto err;
-
+done:
 	INIT_LIST_HEAD (&pool->all_frames);
 	INIT_LIST_HEAD (&ctx->cmd_args.xlator_options);
 	LOCK_INIT (&pool->lock);
@@ -144,7 +159,7 @@ err:
 		GF_FREE (pool);
 	}
 
-	if (ret && ctx) {
+	if (ret && ctx && !shared) {
 		if (ctx->stub_mem_pool)
 			mem_pool_destroy (ctx->stub_mem_pool);
 		if (ctx->dict_pool)
@@ -164,6 +179,15 @@ create_master (struct glfs *fs)
 {
 	int		 ret = 0;
 	xlator_t	*master = NULL;
+	struct glfs_master_priv *priv = NULL;
+
+	priv = GF_CALLOC (1, sizeof (*priv), glfs_mt_glfs_master_priv_t);
+	if (!priv)
+		goto err;
+
+	pthread_mutex_init (&priv->mutex, NULL);
+	pthread_cond_init (&priv->cond, NULL);
+	priv->fs = fs;
 
 	master = GF_CALLOC (1, sizeof (*master),
 			    glfs_mt_xlator_t);
@@ -182,7 +206,7 @@ create_master (struct glfs *fs)
 	}
 
 	master->ctx	 = fs->ctx;
-	master->private	 = fs;
+	master->private	 = priv;
 	master->options	 = get_new_dict ();
 	if (!master->options)
 		goto err;
@@ -196,6 +220,7 @@ create_master (struct glfs *fs)
 	}
 
 	fs->ctx->master = master;
+	fs->master_priv = priv;
 	THIS = master;
 
 	return 0;
@@ -205,6 +230,12 @@ err:
 		xlator_destroy (master);
 	}
 
+	if (priv) {
+		pthread_mutex_destroy (&priv->mutex);
+		pthread_cond_destroy (&priv->cond);
+		GF_FREE (priv);
+	}
+
 	return -1;
 }
 
@@ -320,6 +351,128 @@ enomem:
 }
 
 
+int
+glfs_set_attr_timeout (struct glfs *fs, unsigned int msecs)
+{
+	fs->attr_timeout = msecs;
+
+	return 0;
+}
+
+
+int
+glfs_set_negative_timeout (struct glfs *fs, unsigned int msecs)
+{
+	fs->negative_timeout = msecs;
+
+	return 0;
+}
+
+
+int
+glfs_set_readdir_size (struct glfs *fs, size_t size)
+{
+	if (size < GLFS_READDIR_MIN_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fs->readdir_size = size;
+
+	return 0;
+}
+
+
+int
+glfs_set_read_ahead (struct glfs *fs, unsigned int pages, size_t page_size)
+{
+	if (pages > GLFS_RA_MAX_PAGES || (pages && !page_size)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fs->ra_pages = pages;
+	fs->ra_page_size = page_size;
+
+	return 0;
+}
+
+
+static void
+glfs_itable_set_lru_limit (xlator_t *subvol, uint32_t lru_limit)
+{
+	inode_table_t *itable = NULL;
+
+	if (!subvol || !subvol->itable)
+		return;
+
+	itable = subvol->itable;
+
+	/* inodes over the new limit are purged as they get released */
+	pthread_mutex_lock (&itable->lock);
+	{
+		itable->lru_limit = lru_limit;
+	}
+	pthread_mutex_unlock (&itable->lock);
+}
+
+
+int
+glfs_set_inode_cache (struct glfs *fs, unsigned int lru_limit)
+{
+	pthread_mutex_lock (&fs->mutex);
+	{
+		fs->inode_lru_limit = lru_limit;
+
+		glfs_itable_set_lru_limit (fs->active_subvol, lru_limit);
+		if (fs->next_subvol != fs->active_subvol)
+			glfs_itable_set_lru_limit (fs->next_subvol, lru_limit);
+	}
+	pthread_mutex_unlock (&fs->mutex);
+
+	return 0;
+}
+
+
+int
+glfs_get_inode_cache_stats (struct glfs *fs,
+			    struct glfs_inode_cache_stats *stats)
+{
+	inode_table_t *itable = NULL;
+	int            ret = -1;
+
+	memset (stats, 0, sizeof (*stats));
+
+	/* only peek, a pending graph switch is left to the next fop */
+	pthread_mutex_lock (&fs->mutex);
+	{
+		if (!fs->active_subvol || !fs->active_subvol->itable) {
+			errno = ENOTCONN;
+			goto unlock;
+		}
+
+		itable = fs->active_subvol->itable;
+
+		pthread_mutex_lock (&itable->lock);
+		{
+			stats->lru_limit = itable->lru_limit;
+			stats->active = itable->active_size;
+			stats->lru = itable->lru_size;
+			stats->purge = itable->purge_size;
+		}
+		pthread_mutex_unlock (&itable->lock);
+
+		stats->purged = fs->master_priv->purged;
+
+		ret = 0;
+	}
+unlock:
+	pthread_mutex_unlock (&fs->mutex);
+
+	return ret;
+}
+
+
 struct glfs *
 glfs_from_glfd (struct glfs_fd *glfd)
 {
@@ -327,6 +480,101 @@ glfs_from_glfd (struct glfs_fd *glfd)
 }
 
 
+/* Frame of a fop wound in the background, which may still be in flight
+   once the call that sent it returned. glfs_fini() waits for it.
+*/
+call_frame_t *
+glfs_bg_frame_new (struct glfs *fs)
+{
+	call_frame_t *frame = NULL;
+
+	frame = syncop_create_frame (THIS);
+	if (frame)
+		__sync_fetch_and_add (&fs->bg_frames, 1);
+
+	return frame;
+}
+
+
+void
+glfs_bg_frame_destroy (struct glfs *fs, call_frame_t *frame)
+{
+	STACK_DESTROY (frame->root);
+
+	if (__sync_sub_and_fetch (&fs->bg_frames, 1))
+		return;
+
+	/* under @fs->mutex, not to slip in between the check and the wait
+	   of glfs_fini() */
+	pthread_mutex_lock (&fs->mutex);
+	{
+		pthread_cond_broadcast (&fs->cond);
+	}
+	pthread_mutex_unlock (&fs->mutex);
+}
+
+
+/* The glfs_t of an event reaching @master, NULL once glfs_fini() is
+   done with it. Usable until glfs_master_put(), which glfs_fini() waits
+   for.
+*/
+struct glfs *
+glfs_master_get (xlator_t *master)
+{
+	struct glfs_master_priv *priv = NULL;
+	struct glfs             *fs = NULL;
+
+	priv = master->private;
+
+	pthread_mutex_lock (&priv->mutex);
+	{
+		fs = priv->fs;
+		if (fs)
+			priv->refs++;
+	}
+	pthread_mutex_unlock (&priv->mutex);
+
+	return fs;
+}
+
+
+/* Also runs the init callback glfs_init_done() left pending, once @fs
+   is put, so that it may call glfs_fini()
+*/
+void
+glfs_master_put (struct glfs *fs)
+{
+	struct glfs_master_priv *priv = NULL;
+	glfs_init_cbk            init_cbk = NULL;
+	int                      ret = 0;
+
+	if (!fs)
+		return;
+
+	pthread_mutex_lock (&fs->mutex);
+	{
+		if (fs->init_cbk_pending) {
+			fs->init_cbk_pending = 0;
+			init_cbk = fs->init_cbk;
+			ret = fs->ret;
+		}
+	}
+	pthread_mutex_unlock (&fs->mutex);
+
+	priv = fs->master_priv;
+
+	pthread_mutex_lock (&priv->mutex);
+	{
+		if (!--priv->refs)
+			pthread_cond_broadcast (&priv->cond);
+	}
+	pthread_mutex_unlock (&priv->mutex);
+
+	if (init_cbk)
+		init_cbk (fs, ret);
+}
+
+
 struct glfs_fd *
 glfs_fd_new (struct glfs *fs)
 {
@@ -338,7 +586,10 @@ glfs_fd_new (struct glfs *fs)
 
 	glfd->fs = fs;
 
+	LOCK_INIT (&glfd->lock);
+
 	INIT_LIST_HEAD (&glfd->openfds);
+	INIT_LIST_HEAD (&glfd->migrate);
 
 	return glfd;
 }
@@ -361,17 +612,35 @@ glfs_fd_bind (struct glfs_fd *glfd)
 void
 glfs_fd_destroy (struct glfs_fd *glfd)
 {
+	xlator_t *held = NULL;
+
 	if (!glfd)
 		return;
 
 	glfs_lock (glfd->fs);
 	{
+		/* a background migration may still be using it */
+		while (glfd->migrating)
+			pthread_cond_wait (&glfd->fs->cond, &glfd->fs->mutex);
+
 		list_del_init (&glfd->openfds);
+		list_del_init (&glfd->migrate);
+
+		held = glfd->held_subvol;
+		glfd->held_subvol = NULL;
 	}
 	glfs_unlock (glfd->fs);
 
+	glfs_subvol_done (glfd->fs, held);
+
+	glfs_wb_destroy (glfd);
+	glfs_ra_destroy (glfd);
+	glfs_rda_destroy (glfd);
+
 	if (glfd->fd)
 		fd_unref (glfd->fd);
+
+	LOCK_DESTROY (&glfd->lock);
 	GF_FREE (glfd);
 }
 
@@ -389,10 +658,43 @@ glfs_poller (void *data)
 }
 
 
-struct glfs *
-glfs_new (const char *volname)
+static void *
+glfs_ctx_poller (void *data)
+{
+	struct glfs_ctx  *shared = NULL;
+
+	shared = data;
+
+	event_dispatch (shared->ctx->event_pool);
+
+	return NULL;
+}
+
+
+/* One poller serves all the glfs_t sharing @shared */
+static int
+glfs_ctx_poller_start (struct glfs_ctx *shared)
+{
+	int  ret = 0;
+
+	pthread_mutex_lock (&shared->mutex);
+	{
+		if (!shared->poller_running) {
+			ret = pthread_create (&shared->poller, NULL,
+					      glfs_ctx_poller, shared);
+			if (ret == 0)
+				shared->poller_running = 1;
+		}
+	}
+	pthread_mutex_unlock (&shared->mutex);
+
+	return ret;
+}
+
+
+static glusterfs_ctx_t *
+glfs_ctx_create (struct glfs_ctx *shared)
 {
-	struct glfs     *fs = NULL;
 	int              ret = -1;
 	glusterfs_ctx_t *ctx = NULL;
 
@@ -413,14 +715,66 @@ glfs_new (const char *volname)
 	THIS->ctx = ctx;
 
 	/* then ctx_defaults_init, for xlator_mem_acct_init(THIS) */
-	ret = glusterfs_ctx_defaults_init (ctx);
+	ret = glusterfs_ctx_defaults_init (ctx, shared);
 	if (ret)
 		return NULL;
 
+	return ctx;
+}
+
+
+struct glfs_ctx *
+glfs_ctx_new (void)
+{
+	struct glfs_ctx *shared = NULL;
+	glusterfs_ctx_t *ctx = NULL;
+
+	/* not GF_CALLOC()ed, there is no ctx to account it to yet, and
+	   nothing to undo when creating the ctx fails */
+	shared = calloc (1, sizeof (*shared));
+	if (!shared) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ctx = glfs_ctx_create (NULL);
+	if (!ctx) {
+		free (shared);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	shared->ctx = ctx;
+	pthread_mutex_init (&shared->mutex, NULL);
+
+	return shared;
+}
+
+
+struct glfs *
+glfs_new_from_ctx (struct glfs_ctx *shared, const char *volname)
+{
+	struct glfs     *fs = NULL;
+	glusterfs_ctx_t *ctx = NULL;
+
+	ctx = glfs_ctx_create (shared);
+	if (!ctx)
+		return NULL;
+
 	fs = GF_CALLOC (1, sizeof (*fs), glfs_mt_glfs_t);
 	if (!fs)
 		return NULL;
 	fs->ctx = ctx;
+	fs->shared = shared;
+
+	if (shared) {
+		/* glfs_ctx_fini() refuses until glfs_fini() drops it */
+		pthread_mutex_lock (&shared->mutex);
+		{
+			shared->users++;
+		}
+		pthread_mutex_unlock (&shared->mutex);
+	}
 
 	glfs_set_logging (fs, "/dev/null", 0);
 
@@ -432,11 +786,28 @@ glfs_new (const char *volname)
 	pthread_cond_init (&fs->cond, NULL);
 
 	INIT_LIST_HEAD (&fs->openfds);
+	INIT_LIST_HEAD (&fs->migrate_fds);
+
+	fs->readdir_size = GLFS_READDIR_SIZE;
+	fs->inode_lru_limit = GLFS_INODE_LRU_LIMIT;
+
+	LOCK_INIT (&fs->dircache_lock);
+	/* not fatal, resolution just walks every component without it */
+	fs->dircache = GF_CALLOC (GLFS_DIRCACHE_SIZE,
+				  sizeof (struct glfs_dircache_entry),
+				  glfs_mt_glfs_dircache_t);
 
 	return fs;
 }
 
 
+struct glfs *
+glfs_new (const char *volname)
+{
+	return glfs_new_from_ctx (NULL, volname);
+}
+
+
 int
 glfs_set_volfile (struct glfs *fs, const char *volfile)
 {
@@ -473,6 +844,26 @@ glfs_set_volfile_server (struct glfs *fs, const char *transport,
 }
 
 
+int
+glfs_set_volfile_cache (struct glfs *fs, const char *dir)
+{
+	char *cache = NULL;
+
+	if (dir) {
+		cache = gf_strdup (dir);
+		if (!cache) {
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	GF_FREE (fs->volfile_cache);
+	fs->volfile_cache = cache;
+
+	return 0;
+}
+
+
 int
 glfs_set_logging (struct glfs *fs, const char *logfile, int loglevel)
 {
@@ -534,11 +925,12 @@ glfs_init_done (struct glfs *fs, int ret)
 
 		if (!init_cbk)
 			pthread_cond_broadcast (&fs->cond);
+		else
+			/* called by glfs_master_put(), out of the event
+			   path's hold on @fs */
+			fs->init_cbk_pending = 1;
 	}
 	pthread_mutex_unlock (&fs->mutex);
-
-	if (init_cbk)
-		init_cbk (fs, ret);
 out:
 	return;
 }
@@ -553,7 +945,13 @@ glfs_init_common (struct glfs *fs)
 	if (ret)
 		return ret;
 
-	ret = pthread_create (&fs->poller, NULL, glfs_poller, fs);
+	if (fs->shared) {
+		ret = glfs_ctx_poller_start (fs->shared);
+	} else {
+		ret = pthread_create (&fs->poller, NULL, glfs_poller, fs);
+		if (ret == 0)
+			fs->poller_running = 1;
+	}
 	if (ret)
 		return ret;
 
@@ -594,12 +992,342 @@ glfs_init (struct glfs *fs)
 }
 
 
+/* Closes the glfds the application left open */
+static void
+glfs_fini_openfds (struct glfs *fs)
+{
+	struct glfs_fd  *glfd = NULL;
+	int              isdir = 0;
+
+	for (;;) {
+		glfd = NULL;
+
+		glfs_lock (fs);
+		{
+			if (!list_empty (&fs->openfds))
+				glfd = list_entry (fs->openfds.next,
+						   struct glfs_fd, openfds);
+		}
+		glfs_unlock (fs);
+
+		if (!glfd)
+			break;
+
+		LOCK (&glfd->lock);
+		{
+			isdir = (glfd->fd &&
+				 glfd->fd->inode->ia_type == IA_IFDIR);
+		}
+		UNLOCK (&glfd->lock);
+
+		/* both take @glfd off @fs->openfds, even on failure */
+		if (isdir)
+			glfs_closedir (glfd);
+		else
+			glfs_close (glfd);
+	}
+}
+
+
+/* Brings the bricks of the active graph down, waiting for its
+   CHILD_DOWN so that no notification is left to reach @fs */
+static void
+glfs_fini_subvol (struct glfs *fs)
+{
+	xlator_t        *subvol = NULL;
+	struct timespec  timeout = {0, };
+	int              ret = 0;
+
+	subvol = glfs_active_subvol (fs);
+	if (!subvol)
+		return;
+
+	/* PARENT_DOWN is otherwise only sent on graph switch, once the
+	   old graph is idle */
+	xlator_notify (subvol, GF_EVENT_PARENT_DOWN, subvol, 0);
+
+	timeout.tv_sec = time (NULL) + GLFS_FINI_TIMEOUT;
+
+	pthread_mutex_lock (&fs->mutex);
+	{
+		while (!fs->fini_down && ret != ETIMEDOUT)
+			ret = pthread_cond_timedwait (&fs->cond, &fs->mutex,
+						      &timeout);
+	}
+	pthread_mutex_unlock (&fs->mutex);
+
+	if (ret == ETIMEDOUT)
+		gf_log ("glfs", GF_LOG_WARNING,
+			"%s: bricks still up after %d secs, going ahead",
+			fs->volname, GLFS_FINI_TIMEOUT);
+
+	glfs_subvol_done (fs, subvol);
+}
+
+
+/* Frees @ctx, with its buffer and memory pools unless borrowed from a
+   glfs_ctx, as far as libglusterfs allows. The graphs, the syncenv
+   threads, the timer thread and the event pool have no teardown there
+   and are left as they are.
+*/
+static void
+glfs_ctx_free (glusterfs_ctx_t *ctx, gf_boolean_t pools)
+{
+	xlator_t                *master = NULL;
+	struct glfs_master_priv *priv = NULL;
+	xlator_cmdline_option_t *option = NULL;
+	xlator_cmdline_option_t *tmp = NULL;
+
+	list_for_each_entry_safe (option, tmp, &ctx->cmd_args.xlator_options,
+				  cmd_args) {
+		list_del_init (&option->cmd_args);
+		GF_FREE (option->volume);
+		GF_FREE (option->key);
+		GF_FREE (option->value);
+		GF_FREE (option);
+	}
+
+	GF_FREE (ctx->cmd_args.volfile_id);
+	GF_FREE (ctx->cmd_args.volfile);
+	GF_FREE (ctx->cmd_args.volfile_server);
+	GF_FREE (ctx->cmd_args.volfile_server_transport);
+
+	master = ctx->master;
+	if (master) {
+		priv = master->private;
+		pthread_mutex_destroy (&priv->mutex);
+		pthread_cond_destroy (&priv->cond);
+		GF_FREE (priv);
+
+		/* allocations are accounted to THIS, which must outlive
+		   them */
+		THIS = &global_xlator;
+
+		ctx->master = NULL;
+		xlator_destroy (master);
+	}
+
+	if (global_xlator.ctx == ctx)
+		/* the global xlator of libglusterfs still uses it */
+		return;
+
+	if (pools) {
+		mem_pool_destroy (ctx->stub_mem_pool);
+		mem_pool_destroy (ctx->dict_pool);
+		mem_pool_destroy (ctx->dict_pair_pool);
+		mem_pool_destroy (ctx->dict_data_pool);
+		iobuf_pool_destroy (ctx->iobuf_pool);
+	}
+
+	GF_FREE (ctx->process_uuid);
+	pthread_mutex_destroy (&ctx->lock);
+	FREE (ctx);
+}
+
+
+/* Frees the call pool of @ctx, of a glfs_t already freed, then the rest
+   of it. With @shared, the rest waits for glfs_ctx_fini(): the shared
+   poller may still deliver late events of the transports of @ctx to
+   its master.
+*/
+static void
+glfs_ctx_destroy (glusterfs_ctx_t *ctx, struct glfs_ctx *shared)
+{
+	call_pool_t          *pool = NULL;
+	struct glfs_ctx_left *left = NULL;
+
+	pool = ctx->pool;
+	if (pool->cnt) {
+		/* frames libglusterfs sent on its own, keep what they use */
+		gf_log ("glfs", GF_LOG_WARNING,
+			"%"PRId64" frames still in flight, not freeing the "
+			"context", pool->cnt);
+		ctx = NULL;
+	} else {
+		ctx->pool = NULL;
+		mem_pool_destroy (pool->frame_mem_pool);
+		mem_pool_destroy (pool->stack_mem_pool);
+		LOCK_DESTROY (&pool->lock);
+		GF_FREE (pool);
+	}
+
+	if (!shared) {
+		if (ctx)
+			glfs_ctx_free (ctx, _gf_true);
+		return;
+	}
+
+	if (ctx) {
+		/* not GF_CALLOC()ed, like @shared */
+		left = calloc (1, sizeof (*left));
+		if (left)
+			left->ctx = ctx;
+	}
+
+	pthread_mutex_lock (&shared->mutex);
+	{
+		if (left) {
+			left->next = shared->left;
+			shared->left = left;
+		}
+		shared->users--;
+	}
+	pthread_mutex_unlock (&shared->mutex);
+}
+
+
+int
+glfs_ctx_fini (struct glfs_ctx *shared)
+{
+	struct glfs_ctx_left *left = NULL;
+	int                   users = 0;
+	gf_boolean_t          pools = _gf_true;
+
+	pthread_mutex_lock (&shared->mutex);
+	{
+		users = shared->users;
+	}
+	pthread_mutex_unlock (&shared->mutex);
+
+	if (users) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	/* the masters freed below may be THIS in this thread */
+	THIS = &global_xlator;
+
+	if (shared->poller_running) {
+		/* idle in epoll_wait() with all the glfs_t gone, and
+		   libglusterfs has no way to end event_dispatch() */
+		pthread_cancel (shared->poller);
+		pthread_join (shared->poller, NULL);
+	}
+
+	while (shared->left) {
+		left = shared->left;
+		shared->left = left->next;
+
+		/* kept as the global one, along with the pools it uses */
+		if (left->ctx == global_xlator.ctx)
+			pools = _gf_false;
+
+		glfs_ctx_free (left->ctx, _gf_false);
+		free (left);
+	}
+
+	if (pools)
+		glfs_ctx_destroy (shared->ctx, NULL);
+
+	pthread_mutex_destroy (&shared->mutex);
+	free (shared);
+
+	return 0;
+}
+
+
 int
 glfs_fini (struct glfs *fs)
 {
-	int  ret = -1;
+	glusterfs_ctx_t  *ctx = NULL;
+	struct glfs_ctx  *shared = NULL;
+	struct timespec   timeout = {0, };
+	int               init = 0;
+	int               ret = 0;
 
-	return ret;
+	__glfs_entry_fs (fs);
+
+	glfs_mgmt_fini (fs);
+
+	pthread_mutex_lock (&fs->mutex);
+	{
+		init = fs->init;
+	}
+	pthread_mutex_unlock (&fs->mutex);
+
+	if (init)
+		glfs_fini_openfds (fs);
+
+	timeout.tv_sec = time (NULL) + GLFS_FINI_TIMEOUT;
+
+	pthread_mutex_lock (&fs->mutex);
+	{
+		/* nothing is left to migrate, the workers are about to
+		   exit */
+		while (fs->migrate_workers)
+			pthread_cond_wait (&fs->cond, &fs->mutex);
+
+		/* background fops (async IO, read-ahead, write-behind,
+		   readdir prefetch) still in flight */
+		while (fs->bg_frames && ret != ETIMEDOUT)
+			ret = pthread_cond_timedwait (&fs->cond, &fs->mutex,
+						      &timeout);
+
+		if (fs->bg_frames)
+			ret = EBUSY;
+		else
+			fs->fini = 1;
+	}
+	pthread_mutex_unlock (&fs->mutex);
+
+	if (ret == EBUSY) {
+		/* their callbacks still refer to @fs, keep it around. What
+		   was torn down so far stays so, a retry resumes here */
+		gf_log ("glfs", GF_LOG_WARNING,
+			"%s: %d fops still in flight, not freeing",
+			fs->volname, fs->bg_frames);
+		errno = EBUSY;
+		return -1;
+	}
+
+	if (init)
+		glfs_fini_subvol (fs);
+
+	glfs_dircache_flush (fs);
+	GF_FREE (fs->dircache);
+	LOCK_DESTROY (&fs->dircache_lock);
+
+	if (fs->cwd)
+		inode_unref (fs->cwd);
+
+	/* late events from the poller find no @fs any more, and those
+	   still using it are waited for */
+	if (fs->master_priv) {
+		pthread_mutex_lock (&fs->master_priv->mutex);
+		{
+			fs->master_priv->fs = NULL;
+			while (fs->master_priv->refs)
+				pthread_cond_wait (&fs->master_priv->cond,
+						   &fs->master_priv->mutex);
+		}
+		pthread_mutex_unlock (&fs->master_priv->mutex);
+	}
+
+	if (fs->poller_running) {
+		/* with the bricks and the management server gone it idles
+		   in epoll_wait(), and libglusterfs has no way to end
+		   event_dispatch() */
+		pthread_cancel (fs->poller);
+		pthread_join (fs->poller, NULL);
+	}
+
+	GF_FREE (fs->volname);
+	GF_FREE (fs->oldvolfile);
+	GF_FREE (fs->volfile_cache);
+	if (fs->oldvolgraph)
+		glusterfs_graph_destroy (fs->oldvolgraph);
+
+	pthread_mutex_destroy (&fs->mutex);
+	pthread_cond_destroy (&fs->cond);
+
+	ctx = fs->ctx;
+	shared = fs->shared;
+
+	GF_FREE (fs);
+
+	glfs_ctx_destroy (ctx, shared);
+
+	return 0;
 }
 
 int
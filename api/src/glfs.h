@@ -41,6 +41,8 @@
 #include <sys/cdefs.h>
 #include <dirent.h>
 #include <sys/statvfs.h>
+#include <stdint.h>
+#include <stddef.h>
 
 /* Values for valid falgs to be used when using XXXsetattr, to set multiple 
    attribute values passed via the related stat structure.
@@ -99,6 +101,100 @@ typedef struct glfs_gfid glfs_gfid_t;
 glfs_t *glfs_new (const char *volname);
 
 
+struct glfs_ctx;
+typedef struct glfs_ctx glfs_ctx_t;
+
+/*
+  SYNOPSIS
+
+  glfs_ctx_new: Create a context to be shared by 'virtual mount' objects.
+
+  DESCRIPTION
+
+  Every glfs_t created with glfs_new() runs its own event thread and
+  synctask threads and allocates its own buffer and memory pools. A
+  process mounting many volumes can create one glfs_ctx_t instead and
+  pass it to glfs_new_from_ctx(), so that all those glfs_t share a single
+  event thread, synctask environment and set of pools, while each keeps
+  its own volume graph and management connection.
+
+  The context is released with glfs_ctx_fini(), once every glfs_t
+  created on it has been released with glfs_fini().
+
+  PARAMETERS
+
+  None.
+
+  RETURN VALUES
+
+  NULL   : Out of memory condition.
+  Others : Pointer to the newly created glfs_ctx_t object.
+
+*/
+
+glfs_ctx_t *glfs_ctx_new (void);
+
+
+/*
+  SYNOPSIS
+
+  glfs_new_from_ctx: Create a new 'virtual mount' object on a shared context.
+
+  DESCRIPTION
+
+  Same as glfs_new(), except that the glfs_t uses the threads and pools of
+  @ctx. glfs_fini() on it leaves @ctx, and the other glfs_t using it,
+  untouched.
+
+  All glfs_t on @ctx share a single event thread and a single set of
+  synctask threads, which run the glfs_io_cbk of every asynchronous call
+  on any of them. A callback may call into gfapi synchronously, but one
+  that is slow or blocks keeps a synctask thread busy for all these
+  volumes.
+
+  PARAMETERS
+
+  @ctx: Context returned by glfs_ctx_new().
+
+  @volname: Name of the volume, as for glfs_new().
+
+  RETURN VALUES
+
+  NULL   : Out of memory condition.
+  Others : Pointer to the newly created glfs_t virtual mount object.
+
+*/
+
+glfs_t *glfs_new_from_ctx (glfs_ctx_t *ctx, const char *volname);
+
+
+/*
+  SYNOPSIS
+
+  glfs_ctx_fini: Release a context shared by 'virtual mount' objects.
+
+  DESCRIPTION
+
+  Stops the event thread of @ctx and frees its pools, along with what
+  glfs_fini() had to keep of the glfs_t created on it. As with
+  glfs_fini(), the synctask threads, the timer thread and the event pool
+  cannot be released by libglusterfs and stay until the process exits.
+
+  PARAMETERS
+
+  @ctx: Context returned by glfs_ctx_new().
+
+  RETURN VALUES
+
+   0 : Success, @ctx must not be used any more.
+  -1 : Failure. @errno is set to EBUSY while a glfs_t created on @ctx has
+       not been released with glfs_fini() yet, @ctx is left untouched.
+
+*/
+
+int glfs_ctx_fini (glfs_ctx_t *ctx);
+
+
 /*
   SYNOPSIS
 
@@ -178,6 +274,36 @@ int glfs_set_volfile_server (glfs_t *fs, const char *transport,
 			     const char *host, int port);
 
 
+/*
+  SYNOPSIS
+
+  glfs_set_volfile_cache: Keep the fetched volume specification on disk.
+
+  DESCRIPTION
+
+  With a volfile server set, the volume specification fetched from the
+  management server is saved under @dir, and glfs_init() builds the
+  'virtual mount' from the saved copy right away instead of waiting for
+  the management server. The specification is fetched again in the
+  background, and the 'virtual mount' switches over only if it changed.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be configured.
+
+  @dir: An existing directory, writable by the process. NULL disables the
+        cache (default.)
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_set_volfile_cache (glfs_t *fs, const char *dir);
+
+
 /*
   SYNOPSIS
 
@@ -235,6 +361,49 @@ int glfs_set_logging (glfs_t *fs, const char *logfile, int loglevel);
 int glfs_init (glfs_t *fs);
 
 
+/*
+  SYNOPSIS
+
+  glfs_fini: Tear down the 'virtual mount'
+
+  DESCRIPTION
+
+  This function releases the glfs_t object:
+  - Stop fetching volume specification updates.
+  - Close the glfs_fd_t left open (pending writes are flushed.)
+  - Wait up to 10 seconds for background IO to complete.
+  - Disconnect from the bricks.
+  - Stop the poll-loop thread, unless the glfs_t was created with
+    glfs_new_from_ctx().
+  - Free the glfs_t object, its frame pools, and, unless created with
+    glfs_new_from_ctx(), its buffer and memory pools.
+
+  glfs_object handles must be closed with glfs_h_close() before.
+
+  libglusterfs cannot tear down the rest, which stays allocated until
+  the process exits: the translator graphs of the volume with their
+  inode tables, the synctask threads, the timer thread and the event
+  pool. Neither is the context libglusterfs keeps as its global one,
+  that of the last glfs_t created from a thread not using any glfs_t
+  yet, nor its pools. With glfs_new_from_ctx(), the master translator
+  and the context of the glfs_t are kept until glfs_ctx_fini(), as the
+  shared event thread may still deliver late events to them.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be torn down.
+
+  RETURN VALUES
+
+   0 : Success, @fs must not be used any more.
+  -1 : Failure. @errno will be set with the type of failure. With EBUSY
+       IO was still in progress and @fs is not freed, but it is already
+       disconnected from the management server and its fds are closed.
+       The only call still allowed on it is glfs_fini() again, which
+       resumes waiting for the IO.
+
+*/
+
 int glfs_fini (glfs_t *fs);
 
 /*
@@ -332,6 +501,197 @@ glfs_t *glfs_from_glfd (glfs_fd_t *fd);
 int glfs_set_xlator_option (glfs_t *fs, const char *xlator, const char *key,
 			    const char *value);
 
+/*
+  SYNOPSIS
+
+  glfs_set_attr_timeout: Enable caching of attributes for path lookups.
+
+  DESCRIPTION
+
+  By default every path based call looks up the last component of the
+  path on the bricks. With a non-zero @msecs the attributes returned by
+  a lookup are cached on the inode and reused by later calls for up to
+  @msecs milliseconds. Changes made through this 'virtual mount'
+  invalidate the cache; changes made by other clients may not be seen
+  until the timeout expires.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be configured.
+
+  @msecs: Cache timeout in milliseconds. 0 disables the cache (default.)
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_set_attr_timeout (glfs_t *fs, unsigned int msecs);
+
+/*
+  SYNOPSIS
+
+  glfs_set_negative_timeout: Enable caching of failed (ENOENT) lookups.
+
+  DESCRIPTION
+
+  With a non-zero @msecs, a name found not to exist in a directory is
+  remembered for up to @msecs milliseconds, and looking it up again in
+  that time fails with ENOENT without contacting the bricks. Creating
+  or renaming the name through this 'virtual mount' drops the entry;
+  a name created by another client may not be seen until the timeout
+  expires.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be configured.
+
+  @msecs: Cache timeout in milliseconds. 0 disables the cache (default.)
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_set_negative_timeout (glfs_t *fs, unsigned int msecs);
+
+/*
+  SYNOPSIS
+
+  glfs_set_readdir_size: Set how much a directory read asks for at once.
+
+  DESCRIPTION
+
+  Entries of a directory are read from the bricks in batches of up to
+  @size bytes, and the next batch is read while the application goes
+  through the current one. Larger batches mean fewer round trips for
+  big directories.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be configured.
+
+  @size: Batch size in bytes, at least 4096. Defaults to 131072.
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_set_readdir_size (glfs_t *fs, size_t size);
+
+/*
+  SYNOPSIS
+
+  glfs_set_read_ahead: Prefetch data for sequential readers.
+
+  DESCRIPTION
+
+  Once reads through a glfs_fd_t (glfs_read(), glfs_pread() and their
+  vector and zero-copy variants) continue where the previous one ended,
+  up to @pages asynchronous reads of @page_size bytes each are kept in
+  flight ahead of the reader, and later reads are served from their
+  data. A read at any other offset, or a write, truncate, fallocate or
+  discard through the same glfs_fd_t, drops the prefetched data.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be configured.
+
+  @pages: Number of reads kept in flight, at most 64. 0 disables
+  read-ahead (default.)
+
+  @page_size: Size of each of those reads in bytes.
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_set_read_ahead (glfs_t *fs, unsigned int pages, size_t page_size);
+
+/*
+  SYNOPSIS
+
+  glfs_set_inode_cache: Set how many unused inodes are kept cached.
+
+  DESCRIPTION
+
+  Inodes which are no longer referenced by the application (open
+  glfs_fd_t or glfs_object) stay cached in least recently used order,
+  so that looking them up again is cheap, until there are more than
+  @lru_limit of them. Can be called before or after glfs_init(); on a
+  live 'virtual mount' inodes over a lowered limit are dropped as
+  others get released.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be configured.
+
+  @lru_limit: Number of unused inodes kept, 0 for no limit. Defaults
+  to 131072.
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_set_inode_cache (glfs_t *fs, unsigned int lru_limit);
+
+struct glfs_inode_cache_stats {
+	uint32_t lru_limit; /* as set by glfs_set_inode_cache() */
+	uint32_t active;    /* inodes in use */
+	uint32_t lru;       /* unused inodes kept cached */
+	uint32_t purge;     /* inodes queued to be dropped right now */
+	uint64_t purged;    /* inodes dropped so far, only ever grows */
+};
+
+/*
+  SYNOPSIS
+
+  glfs_get_inode_cache_stats: Get the current usage of the inode cache.
+
+  DESCRIPTION
+
+  Fills @stats with the counters of the inode table of the volume
+  currently in use. Sampling @lru and @active over time shows how
+  close the cache runs to its limit.
+
+  @purged counts the inodes looked up, created or listed through @fs
+  which were destroyed since glfs_init(), across graph switches. It
+  never decreases, so the difference between two samples divided by
+  the time between them is the purge rate. Besides the inodes evicted
+  from the cache over @lru_limit, it includes those of files removed
+  or no longer cached after a graph switch, so it is an upper bound of
+  the cache thrash. @purge is only a snapshot of the queue being
+  dropped and usually 0.
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object to be queried.
+
+  @stats: Filled with the counters on success.
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_get_inode_cache_stats (glfs_t *fs,
+				struct glfs_inode_cache_stats *stats);
+
 /*
 
   glfs_io_cbk
@@ -353,6 +713,18 @@ int glfs_set_xlator_option (glfs_t *fs, const char *xlator, const char *key,
   time of issuing the async IO call. This can be used by the
   caller to differentiate different instances of the async requests
   in a common callback function.
+
+  The callback is called from one of the synctask threads of the
+  'virtual mount', never from the caller's thread nor from the one
+  which received the reply. It may make synchronous glfs_*() calls,
+  glfs_close() of @fd included, but it occupies a synctask thread
+  while it runs, so long or blocking work is better handed over to a
+  thread of the application.
+
+  Errors detected before the IO could be issued (e.g EBADFD) are
+  reported through the callback as well. The *_async() call itself
+  only fails, returning -1 without calling the callback, when it is
+  out of memory.
 */
 
 typedef void (*glfs_io_cbk) (glfs_fd_t *fd, ssize_t ret, void *data);
@@ -399,6 +771,416 @@ int glfs_preadv_async (glfs_fd_t *fd, const struct iovec *iov, int count,
 int glfs_pwritev_async (glfs_fd_t *fd, const struct iovec *iov, int count,
 			off_t offset, int flags, glfs_io_cbk fn, void *data);
 
+struct glfs_read_range {
+	off_t                offset;
+	struct iovec        *iov;     /* where the data is read into */
+	int                  iovcnt;
+	ssize_t              ret;     /* set on return: bytes read or -1 */
+	int                  err;     /* set on return: errno if @ret is -1 */
+};
+
+/*
+  SYNOPSIS
+
+  glfs_preadv_multi: Read several byte ranges of a file in one call.
+
+  DESCRIPTION
+
+  Reads, for each of the @nr entries of @ranges, up to the length of its
+  @iov at its @offset into its @iov, like glfs_preadv() would. All the
+  reads are sent in parallel and the call returns once all of them have
+  completed. The result of each read is stored in the @ret and @err of
+  its range. The offset of @fd is not changed.
+
+  PARAMETERS
+
+  @fd: The file to read from.
+
+  @ranges: The ranges to read.
+
+  @nr: Number of entries in @ranges.
+
+  @flags: Same as the @flags of glfs_preadv().
+
+  RETURN VALUES
+
+   0 : All ranges were read, short reads at end of file included.
+  -1 : Failure. @errno is EIO if some of the ranges failed, see their
+       @err, or else the reason none of them could be read.
+
+*/
+
+int glfs_preadv_multi (glfs_fd_t *fd, struct glfs_read_range *ranges, int nr,
+		       int flags);
+
+
+/*
+ * Zero-copy IO.
+ *
+ * A glfs_buf_t is a reference to data held in buffers owned by libgfapi.
+ * It must be released with glfs_buf_release() once the application is
+ * done with the data.
+ */
+
+struct glfs_buf;
+typedef struct glfs_buf glfs_buf_t;
+
+/*
+  SYNOPSIS
+
+  glfs_preadv_zc: Read from a file without copying the data.
+
+  DESCRIPTION
+
+  This function reads up to @count bytes at @offset, just like
+  glfs_pread(). Instead of copying the data into a caller supplied
+  buffer, the buffers in which the data arrived from the network are
+  handed back to the caller through @iov and @iovcnt. The data remains
+  valid until @buf is released with glfs_buf_release().
+
+  PARAMETERS
+
+  @fd: The file to read from.
+
+  @count: Maximum number of bytes to read.
+
+  @offset: Offset in the file to read from.
+
+  @flags: Same as the @flags of glfs_pread().
+
+  @iov: On success, set to an array of @iovcnt vectors describing the data.
+
+  @iovcnt: On success, set to the number of vectors in @iov.
+
+  @buf: On success, set to the reference which pins @iov.
+
+  RETURN VALUES
+
+  >=0 : Number of bytes read. On 0 (end of file) @buf is set to NULL.
+  -1  : Failure. @errno will be set with the type of failure.
+
+ */
+
+ssize_t glfs_preadv_zc (glfs_fd_t *fd, size_t count, off_t offset, int flags,
+			const struct iovec **iov, int *iovcnt,
+			glfs_buf_t **buf);
+
+
+/*
+  SYNOPSIS
+
+  glfs_buf_release: Release a zero-copy buffer.
+
+  DESCRIPTION
+
+  This function drops the reference the application holds on @buf,
+  obtained from glfs_preadv_zc() or glfs_buf_alloc(). The memory is
+  returned to the IO buffer pool once no pending IO uses it any more.
+  The data described by @buf must not be accessed after this call.
+
+  PARAMETERS
+
+  @buf: The buffer to release. NULL is ignored.
+
+  RETURN VALUES
+
+  None.
+
+ */
+
+void glfs_buf_release (glfs_buf_t *buf);
+
+
+/*
+  SYNOPSIS
+
+  glfs_buf_alloc: Allocate a buffer for zero-copy writes.
+
+  DESCRIPTION
+
+  This function allocates a buffer of @size bytes from the IO buffer
+  pool of @fs. The application fills the memory returned in @ptr and
+  passes the buffer to glfs_pwrite_buf(), which sends it down without
+  copying it. The buffer must be released with glfs_buf_release().
+
+  PARAMETERS
+
+  @fs: The 'virtual mount' object the buffer will be written to.
+
+  @size: Size of the buffer.
+
+  @ptr: On success, set to the start of the writable memory.
+
+  RETURN VALUES
+
+  NULL   : Failure. @errno will be set with the type of failure.
+  Others : Pointer to the allocated buffer.
+
+ */
+
+glfs_buf_t *glfs_buf_alloc (glfs_t *fs, size_t size, void **ptr);
+
+
+/*
+  SYNOPSIS
+
+  glfs_pwrite_buf: Write a buffer without copying it.
+
+  DESCRIPTION
+
+  This function writes the first @count bytes of @buf at @offset. @buf
+  is either allocated with glfs_buf_alloc() or returned by
+  glfs_preadv_zc(). The caller keeps its reference on @buf and may
+  release it once the call returns.
+
+  The write-behind translator of the client side graph may acknowledge
+  the write while still holding on to the memory of @buf, so @buf must
+  not be modified until a
+  following glfs_fsync(), glfs_fdatasync() or glfs_close() on @fd has
+  returned. Use a fresh buffer for each write instead of refilling one.
+
+  RETURN VALUES
+
+  >=0 : Number of bytes written.
+  -1  : Failure. @errno will be set with the type of failure.
+
+ */
+
+ssize_t glfs_pwrite_buf (glfs_fd_t *fd, glfs_buf_t *buf, size_t count,
+			 off_t offset, int flags);
+
+/*
+  SYNOPSIS
+
+  glfs_fd_set_write_behind: Coalesce small writes on a file descriptor.
+
+  DESCRIPTION
+
+  With a non-zero @size, writes smaller than @size through @fd which
+  continue where the previous one ended are copied into a buffer of
+  @size bytes and return immediately. The buffer is sent to the bricks
+  asynchronously once full or once a write does not fit in it, after
+  the previously sent buffer is written, so buffers reach the bricks
+  in the order they were filled.
+
+  Buffered writes are on the bricks before any later read, fstat,
+  fsync, fdatasync, ftruncate, fallocate, discard or close of @fd is
+  performed, and before any asynchronous or queued IO on @fd is sent.
+  Asynchronous calls do not wait for that, their fop is queued and sent
+  once the buffers are written, so they remain usable from a glfs_io_cbk.
+  Writes with O_SYNC or O_DSYNC in @flags are never buffered.
+
+  An error of a buffered write is reported by the next synchronous
+  write, read, fstat, fsync, fdatasync, ftruncate, fallocate, discard
+  or close on @fd, which then fails with its errno.
+
+  PARAMETERS
+
+  @fd: The fd to be configured.
+
+  @size: Size of the buffer in bytes, at least 4096. 0 writes out
+  anything buffered and disables write-behind (default.)
+
+  RETURN VALUES
+
+   0 : Success.
+  -1 : Failure. @errno will be set with the type of failure.
+
+*/
+
+int glfs_fd_set_write_behind (glfs_fd_t *fd, size_t size);
+
+/*
+  SYNOPSIS
+
+  glfs_copy_file_range: Copy a range of data from one file to another.
+
+  DESCRIPTION
+
+  Copies up to @len bytes from @fd_in at @off_in to @fd_out at @off_out.
+  The data is read into and written back out of libgfapi's own buffers,
+  in chunks of which several are in flight at once, without passing
+  through the caller. The offsets of @fd_in and @fd_out are not changed.
+
+  PARAMETERS
+
+  @fd_in: The file to copy from.
+
+  @off_in: Offset in @fd_in to copy from.
+
+  @fd_out: The file to copy to, opened on the same 'virtual mount'.
+
+  @off_out: Offset in @fd_out to copy to.
+
+  @len: Number of bytes to copy.
+
+  RETURN VALUES
+
+  >=0 : Number of bytes copied. Less than @len if the end of @fd_in was
+        reached or an error stopped the copy part way.
+  -1  : Failure. @errno will be set with the type of failure. EXDEV if
+        the files belong to different 'virtual mounts', EINVAL if the
+        ranges overlap within the same file.
+
+*/
+
+ssize_t glfs_copy_file_range (glfs_fd_t *fd_in, off_t off_in,
+			      glfs_fd_t *fd_out, off_t off_out, size_t len);
+
+/*
+  SYNOPSIS
+
+  glfs_sendfile: Send data from a file to a local file descriptor.
+
+  DESCRIPTION
+
+  Reads up to @count bytes of @fd at @offset and writes them to @out_fd,
+  a socket, pipe or file of the local system, straight out of the
+  buffers the data arrived in. The next chunk is read while the current
+  one is being written. The offset of @fd is not changed.
+
+  PARAMETERS
+
+  @fd: The file to read from.
+
+  @out_fd: Local file descriptor to write to, in blocking mode.
+
+  @offset: Offset in @fd to read from.
+
+  @count: Number of bytes to send.
+
+  RETURN VALUES
+
+  >=0 : Number of bytes written to @out_fd. Less than @count at the end
+        of @fd, or if an error stopped the transfer part way.
+  -1  : Failure, nothing was written. @errno will be set with the type
+        of failure.
+
+*/
+
+ssize_t glfs_sendfile (glfs_fd_t *fd, int out_fd, off_t offset, size_t count);
+
+
+/*
+ * Batched asynchronous IO.
+ *
+ * An IO queue accepts many read/write/fsync requests in a single
+ * glfs_ioq_submit() call and collects their completions, which the
+ * application reaps in batches with glfs_ioq_getevents(), instead of
+ * getting one glfs_io_cbk callback per request.
+ */
+
+struct glfs_ioq;
+typedef struct glfs_ioq glfs_ioq_t;
+
+#define GLFS_IOQ_READ       1
+#define GLFS_IOQ_WRITE      2
+#define GLFS_IOQ_FSYNC      3
+#define GLFS_IOQ_FDATASYNC  4
+
+struct glfs_ioreq {
+	glfs_fd_t           *fd;
+	int                  op;      /* GLFS_IOQ_* */
+	const struct iovec  *iov;     /* unused for GLFS_IOQ_F*SYNC */
+	int                  iovcnt;
+	off_t                offset;
+	int                  flags;
+	void                *data;    /* returned in glfs_ioevent */
+};
+
+struct glfs_ioevent {
+	glfs_fd_t           *fd;
+	ssize_t              ret;     /* as returned by the synchronous call */
+	int                  err;     /* errno, when @ret is -1 */
+	void                *data;
+};
+
+
+/*
+  SYNOPSIS
+
+  glfs_ioq_create: Create an IO queue.
+
+  DESCRIPTION
+
+  This function creates a queue which can hold up to @depth requests
+  that are in flight or completed but not yet reaped.
+
+  RETURN VALUES
+
+  NULL   : Failure. @errno will be set with the type of failure.
+  Others : Pointer to the new IO queue.
+
+ */
+
+glfs_ioq_t *glfs_ioq_create (glfs_t *fs, int depth);
+
+
+/*
+  SYNOPSIS
+
+  glfs_ioq_submit: Submit a batch of requests.
+
+  DESCRIPTION
+
+  This function sends the @nr requests in @reqs. Only the @reqs array
+  itself may be reused once the call returns. The buffers described by
+  the @iov of read requests must stay valid until their completion is
+  reaped; the data of write requests is consumed before returning.
+
+  Every submitted request results in exactly one glfs_ioevent.
+
+  RETURN VALUES
+
+  >=0 : Number of requests submitted. It is less than @nr when the
+        queue is full.
+  -1  : Failure. @errno will be set with the type of failure (EAGAIN
+        when the queue is full and nothing could be submitted.)
+
+ */
+
+int glfs_ioq_submit (glfs_ioq_t *ioq, struct glfs_ioreq *reqs, int nr);
+
+
+/*
+  SYNOPSIS
+
+  glfs_ioq_getevents: Reap completed requests.
+
+  DESCRIPTION
+
+  This function waits until at least @min_nr requests have completed,
+  or until @timeout (relative, NULL to wait forever) expires, and then
+  returns up to @max_nr completions in @events. It does not wait when
+  the completed and in-flight requests together are fewer than @min_nr,
+  as @min_nr could then never be reached, and returns what has already
+  completed.
+
+  RETURN VALUES
+
+  >=0 : Number of events returned.
+  -1  : Failure. @errno will be set with the type of failure.
+
+ */
+
+int glfs_ioq_getevents (glfs_ioq_t *ioq, int min_nr, int max_nr,
+			struct glfs_ioevent *events, struct timespec *timeout);
+
+
+/*
+  SYNOPSIS
+
+  glfs_ioq_destroy: Destroy an IO queue.
+
+  DESCRIPTION
+
+  This function waits for all requests in flight to complete and frees
+  the queue. Completions not reaped yet are discarded.
+
+ */
+
+int glfs_ioq_destroy (glfs_ioq_t *ioq);
+
 
 off_t glfs_lseek (glfs_fd_t *fd, off_t offset, int whence);
 
@@ -444,6 +1226,96 @@ int glfs_readdir_r (glfs_fd_t *fd, struct dirent *dirent,
 int glfs_readdirplus_r (glfs_fd_t *fd, struct stat *stat, struct dirent *dirent,
 			struct dirent **result);
 
+struct glfs_direntplus {
+	struct dirent        dirent;
+	struct stat          stat;
+};
+
+/*
+  SYNOPSIS
+
+  glfs_readdirplus_batch: Read many directory entries and their
+  attributes at once.
+
+  DESCRIPTION
+
+  Fills up to @nr entries of @entries with the next entries of the
+  directory @fd, like that many calls to glfs_readdirplus_r() would.
+
+  RETURN VALUES
+
+  >0 : Number of entries filled in.
+   0 : End of the directory.
+  -1 : Failure before any entry was read. @errno will be set with the
+       type of failure.
+
+*/
+
+int glfs_readdirplus_batch (glfs_fd_t *fd, struct glfs_direntplus *entries,
+			    int nr);
+
+/* A variable length record filled in by glfs_getdents() */
+struct glfs_dirent {
+	uint64_t             d_ino;
+	int64_t              d_off;
+	uint16_t             d_reclen;  /* of the whole record */
+	uint16_t             d_namelen; /* not counting the NUL */
+	uint8_t              d_type;    /* DT_* */
+	uint8_t              d_flags;   /* GLFS_DIRENT_* */
+	unsigned char        d_gfid[16];
+	char                 d_name[];  /* NUL terminated */
+};
+
+#define GLFS_DIRENT_HAS_STAT   0x01 /* a struct stat follows d_name */
+
+#define GLFS_DIRENT_ALIGN(len) (((len) + 7) & ~((size_t) 7))
+
+/* The struct stat of a record with GLFS_DIRENT_HAS_STAT set */
+#define GLFS_DIRENT_STAT(d)						\
+	((struct stat *) ((char *) (d) +				\
+			  GLFS_DIRENT_ALIGN (offsetof (struct glfs_dirent, \
+						       d_name) +	\
+					     (d)->d_namelen + 1)))
+
+#define GLFS_DIRENT_NEXT(d)						\
+	((struct glfs_dirent *) ((char *) (d) + (d)->d_reclen))
+
+#define GLFS_GETDENTS_STAT     0x01 /* flag: fill in the attributes too */
+
+/*
+  SYNOPSIS
+
+  glfs_getdents: Read directory entries into a packed buffer.
+
+  DESCRIPTION
+
+  Fills @buf with as many of the next entries of the directory @fd as
+  fit in @size bytes, as consecutive struct glfs_dirent records, each
+  aligned to 8 bytes. Step from one record to the next with
+  GLFS_DIRENT_NEXT(). With GLFS_GETDENTS_STAT in @flags each record also
+  carries the attributes of the entry, see GLFS_DIRENT_STAT().
+
+  PARAMETERS
+
+  @fd: The directory to read from.
+
+  @buf: The buffer to fill in, aligned to 8 bytes.
+
+  @size: Size of @buf in bytes.
+
+  @flags: 0 or GLFS_GETDENTS_STAT.
+
+  RETURN VALUES
+
+  >0 : Number of bytes of @buf filled in.
+   0 : End of the directory.
+  -1 : Failure before any entry was read. @errno will be set with the
+       type of failure, EINVAL if @size is too small for the next entry.
+
+*/
+
+ssize_t glfs_getdents (glfs_fd_t *fd, void *buf, size_t size, int flags);
+
 long glfs_telldir (glfs_fd_t *fd);
 
 void glfs_seekdir (glfs_fd_t *fd, long offset);